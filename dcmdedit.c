@@ -212,23 +212,6 @@ again:
 	}
 }
 
-static uint32_t 
-jhash(const char *key)
-{
-	size_t 	 i = 0, length = strlen(key);
-	uint32_t hash = 0;
-
-	while (i != length) {
-		hash += key[i++];
-		hash += hash << 10;
-		hash ^= hash >> 6;
-	}
-	hash += hash << 3;
-	hash ^= hash >> 11;
-	hash += hash << 15;
-	return hash;
-}
-
 static int
 stringeq(const char *p1, const char *p2)
 {
@@ -259,11 +242,11 @@ print_all(enum pmode pmode, const char *out, const struct diveq *dq)
 	const struct dive   *d;
 	struct dive	     tmp;
 	const struct dlog   *dl;
-	size_t		     idx, i, num = 1;
+	size_t		     num = 1;
 	time_t		     last, first;
 	FILE		    *f = stdout;
-	const struct dive ***htab = NULL;
-	const size_t 	     htabsz = 4096;
+	struct fpset	     seen;
+	const struct fpseen *se;
 	
 	TAILQ_FOREACH(d, dq, entries)
 		if (0 == d->datetime) {
@@ -282,9 +265,7 @@ print_all(enum pmode pmode, const char *out, const struct diveq *dq)
 
 	switch (pmode) {
 	case PMODE_NONE:
-		htab = calloc(htabsz, sizeof(struct dive **));
-		if (NULL == htab)
-			err(EXIT_FAILURE, NULL);
+		memset(&seen, 0, sizeof(struct fpset));
 		if (NULL == out) {
 			divecmd_print_open(f, TAILQ_FIRST(dq)->log);
 			divecmd_print_diveq_open(f);
@@ -300,7 +281,7 @@ print_all(enum pmode pmode, const char *out, const struct diveq *dq)
 				continue;
 			} 
 
-			/* Look up in hashtable. */
+			/* Look up in (and add to) fingerprints. */
 
 			if (NULL == d->fprint) {
 				warnx("%s:%zu: no <fingerprint>",
@@ -308,37 +289,15 @@ print_all(enum pmode pmode, const char *out, const struct diveq *dq)
 				continue;
 			}
 
-			idx = jhash(d->fprint) % htabsz;
-			if (NULL == htab[idx]) {
-				htab[idx] = calloc
-					(1, sizeof(struct dive *));
-				if (NULL == htab[idx])
-					err(EXIT_FAILURE, NULL);
-			} 
-
-			for (i = 0; NULL != htab[idx][i]; i++)
-				if (0 == strcmp
-				    (htab[idx][i]->fprint, d->fprint))
-					break;
-
-			if (NULL != htab[idx][i]) {
+			se = divecmd_fpset_add(&seen, d);
+			if (NULL != se) {
 				warnx("%s:%zu: duplicate dive from "
 					"%s:%zu", d->log->file, 
-					d->line, 
-					htab[idx][i]->log->file,
-					htab[idx][i]->line);
+					d->line, se->log->file,
+					se->line);
 				continue;
 			} 
 
-			/* Add to hash line. */
-
-			htab[idx] = reallocarray
-				(htab[idx], i + 2, sizeof(struct dive *));
-			if (NULL == htab[idx])
-				err(EXIT_FAILURE, NULL);
-			htab[idx][i] = d;
-			htab[idx][i + 1] = NULL;
-
 			/* Print dive. */
 
 			if (NULL != out) {
@@ -358,9 +317,7 @@ print_all(enum pmode pmode, const char *out, const struct diveq *dq)
 			divecmd_print_diveq_close(f);
 			divecmd_print_close(f);
 		}
-		for (i = 0; i < htabsz; i++)
-			free(htab[i]);
-		free(htab);
+		divecmd_fpset_free(&seen);
 		break;
 	case PMODE_SPLIT:
 		assert(NULL != TAILQ_FIRST(dq));
@@ -432,7 +389,6 @@ int
 main(int argc, char *argv[])
 {
 	int		 c, rc = 1;
-	size_t		 i;
 	enum pmode	 mode = PMODE_NONE;
 	XML_Parser	 p;
 	struct diveq	 dq;
@@ -466,14 +422,13 @@ main(int argc, char *argv[])
 	argv += optind;
 
 	divecmd_init(&p, &dq, &st, 
-		GROUP_NONE, GROUPSORT_DATETIME);
+		GROUP_NONE, GROUPSORT_DATETIME, WANT_ALL);
 
 	if (0 == argc)
 		rc = divecmd_parse("-", p, &dq, &st);
-
-	for (i = 0; i < (size_t)argc; i++)
-		if ( ! (rc = divecmd_parse(argv[i], p, &dq, &st)))
-			break;
+	else
+		rc = divecmd_parse_many((const char *const *)argv, 
+			argc, &dq, &st);
 
 #if HAVE_PLEDGE
 	if (NULL == out) {
@@ -22,9 +22,11 @@
 #if HAVE_ERR
 # include <err.h>
 #endif
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <expat.h>
@@ -33,39 +35,64 @@
 
 int verbose = 0;
 
+static void
+print_dive(const struct dive *d)
+{
+	const struct sampcols *c = &d->cols;
+	size_t		 i;
+
+	for (i = 0; i < c->sz; i++) {
+		printf("%zu,%zu,", d->num, c->time[i]);
+		if (SAMP_DEPTH & c->flags[i])
+			printf("%g", c->depth[i]);
+		fputc(',', stdout);
+		if (SAMP_TEMP & c->flags[i])
+			printf("%g", c->temp[i]);
+		fputc('\n', stdout);
+	}
+}
+
 static void
 print_all(const struct diveq *dq)
 {
 	const struct dive *d;
-	const struct samp *s;
 
 	TAILQ_FOREACH(d, dq, entries)
-		TAILQ_FOREACH(s, &d->samps, entries) {
-			printf("%zu,%zu,", d->num, s->time);
-			if (SAMP_DEPTH & s->flags)
-				printf("%g", s->depth);
-			fputc(',', stdout);
-			if (SAMP_TEMP & s->flags)
-				printf("%g", s->temp);
-			fputc('\n', stdout);
-		}
+		print_dive(d);
+}
+
+/*
+ * Streaming callback: print and release each dive as it's parsed.
+ */
+static int
+stream_dive(struct dive *d, void *arg)
+{
+	size_t	*ndives = arg;
+
+	print_dive(d);
+	(*ndives)++;
+	return 0;
 }
 
 int
 main(int argc, char *argv[])
 {
-	int		 c, rc = 1;
-	size_t		 i;
+	int		 c, rc = 1, stream = 0;
 	XML_Parser	 p;
 	struct diveq	 dq;
 	struct divestat	 st;
+	size_t		 i, ndives = 0;
 
 #if HAVE_PLEDGE
-	if (-1 == pledge("stdio rpath", NULL))
+	if (-1 == pledge(NULL == getenv("DCMD_CACHE") ?
+	    "stdio rpath" : "stdio rpath wpath cpath", NULL))
 		err(EXIT_FAILURE, "pledge");
 #endif
-	while (-1 != (c = getopt(argc, argv, "v")))
+	while (-1 != (c = getopt(argc, argv, "uv")))
 		switch (c) {
+		case ('u'):
+			stream = 1;
+			break;
 		case ('v'):
 			verbose = 1;
 			break;
@@ -76,13 +103,22 @@ main(int argc, char *argv[])
 	argc -= optind;
 	argv += optind;
 
-	divecmd_init(&p, &dq, &st, GROUP_DIVER, GROUPSORT_DATETIME);
-
-	if (0 == argc)
+	divecmd_init(&p, &dq, &st, GROUP_DIVER, GROUPSORT_DATETIME,
+		SAMP_DEPTH | SAMP_TEMP);
+	st.compact = 1;
+
+	if (stream && 0 == argc)
+		rc = divecmd_parse_stream("-", p, 
+			&dq, &st, stream_dive, &ndives);
+	else if (stream)
+		for (i = 0; i < (size_t)argc && rc; i++)
+			rc = divecmd_parse_stream(argv[i], p, 
+				&dq, &st, stream_dive, &ndives);
+	else if (0 == argc)
 		rc = divecmd_parse("-", p, &dq, &st);
-	for (i = 0; i < (size_t)argc; i++)
-		if ( ! (rc = divecmd_parse(argv[i], p, &dq, &st)))
-			break;
+	else
+		rc = divecmd_parse_many((const char *const *)argv, 
+			argc, &dq, &st);
 
 #if HAVE_PLEDGE
 	if (-1 == pledge("stdio", NULL))
@@ -93,7 +129,7 @@ main(int argc, char *argv[])
 
 	if ( ! rc)
 		goto out;
-	if (TAILQ_EMPTY(&dq)) {
+	if (TAILQ_EMPTY(&dq) && 0 == ndives) {
 		warnx("no dives to display");
 		goto out;
 	}
@@ -103,6 +139,6 @@ out:
 	divecmd_free(&dq, &st);
 	return(rc ? EXIT_SUCCESS : EXIT_FAILURE);
 usage:
-	fprintf(stderr, "usage: %s [-v] [file]\n", getprogname());
+	fprintf(stderr, "usage: %s [-uv] [file]\n", getprogname());
 	return(EXIT_FAILURE);
 }
@@ -59,42 +59,57 @@ struct	limits {
 	TAILQ_ENTRY(limits) entries;
 };
 
+/*
+ * What we're printing and what we've printed so far.
+ */
+struct	find {
+	const char	     *out; /* output directory or NULL */
+	const struct limitq  *lq; /* limits on printed dives */
+	const struct dlog    *dl; /* divelog of first dive or NULL */
+	struct fpset	      seen; /* printed fingerprints */
+};
+
 int verbose = 0;
 
+/*
+ * See if a dive, by its "datetime" (or zero), "pid", and "mode",
+ * matches all limits.
+ */
 static int
-limit_match(const struct dive *d, const struct limitq *lq)
+limit_match(const struct limitq *lq, 
+	time_t datetime, size_t pid, enum mode mode)
 {
 	const struct limits *l;
 
 	TAILQ_FOREACH(l, lq, entries) {
 		switch (l->type) {
 		case LIMIT_DATE_EQ:
-			if (0 == d->datetime)
+			if (0 == datetime)
 				return 0;
-			if (d->datetime < l->date ||
-			    d->datetime > l->date + 60 * 60 * 24)
+			if (datetime < l->date ||
+			    datetime > l->date + 60 * 60 * 24)
 				return 0;
 			continue;
 		case LIMIT_DATE_BEFORE:
 		case LIMIT_DATETIME_BEFORE:
-			if (0 == d->datetime)
+			if (0 == datetime)
 				return 0;
-			if (d->datetime > l->date)
+			if (datetime > l->date)
 				return 0;
 			continue;
 		case LIMIT_DATE_AFTER:
 		case LIMIT_DATETIME_AFTER:
-			if (0 == d->datetime)
+			if (0 == datetime)
 				return 0;
-			if (d->datetime < l->date)
+			if (datetime < l->date)
 				return 0;
 			continue;
 		case LIMIT_DIVE_EQ:
-			if (d->pid != l->pid)
+			if (pid != l->pid)
 				return 0;
 			break;
 		case LIMIT_MODE_EQ:
-			if (l->mode != d->mode)
+			if (l->mode != mode)
 				return 0;
 			continue;
 		}
@@ -103,6 +118,16 @@ limit_match(const struct dive *d, const struct limitq *lq)
 	return 1;
 }
 
+/*
+ * Choose which dives need be parsed in full: those we may print.
+ */
+static int
+select_dive(const struct dindex *di, void *arg)
+{
+
+	return limit_match(arg, di->datetime, di->pid, di->mode);
+}
+
 static FILE *
 file_open(const struct dive *d, const char *out)
 {
@@ -118,23 +143,6 @@ file_open(const struct dive *d, const char *out)
 	return f;
 }
 
-static uint32_t 
-jhash(const char *key)
-{
-	size_t 	 i = 0, length = strlen(key);
-	uint32_t hash = 0;
-
-	while (i != length) {
-		hash += key[i++];
-		hash += hash << 10;
-		hash ^= hash >> 6;
-	}
-	hash += hash << 3;
-	hash ^= hash >> 11;
-	hash += hash << 15;
-	return hash;
-}
-
 static int
 stringeq(const char *p1, const char *p2)
 {
@@ -157,124 +165,141 @@ dlogeq(const struct dlog *d1, const struct dlog *d2)
 }
 
 /*
- * Take a single input file and either split or join it.
+ * Start output with the divelog of the first dive "d".
  */
-static int
-print_all(const char *out, const struct limitq *lq, 
-	const struct diveq *dq)
+static void
+print_open(struct find *fp, const struct dive *d)
 {
-	const struct dive   *d;
-	const struct dlog   *dl;
-	size_t		     idx, i;
-	FILE		    *f = stdout;
-	const struct dive ***htab = NULL;
-	const size_t 	     htabsz = 4096;
-	
-	TAILQ_FOREACH(d, dq, entries)
-		if (0 == d->datetime) {
-			warnx("%s:%zu: no <dive> timestamp",
-				d->log->file, d->line);
-			return 0;
-		}
 
-	/*
-	 * If we don't have a mode specified, simply print out each dive
-	 * into its own file (if "out" is specified) or print them back
-	 * to stdout as one big standalone file.
-	 * They must be from the same divelog (i.e., dive computer),
-	 * however, and the fingerprints must also be unique.
-	 */
-
-	htab = calloc(htabsz, sizeof(struct dive **));
-	if (NULL == htab)
-		err(EXIT_FAILURE, NULL);
-	if (NULL == out) {
-		divecmd_print_open(f, TAILQ_FIRST(dq)->log);
-		divecmd_print_diveq_open(f);
+	fp->dl = d->log;
+	if (NULL == fp->out) {
+		divecmd_print_open(stdout, fp->dl);
+		divecmd_print_diveq_open(stdout);
 	}
-	assert(NULL != TAILQ_FIRST(dq));
-	dl = TAILQ_FIRST(dq)->log;
-	TAILQ_FOREACH(d, dq, entries) {
-		if ( ! dlogeq(dl, d->log)) {
-			warnx("%s:%zu: dive has mismatched "
-				"computer (from %s:%zu)",
-				d->log->file, d->line, 
-				dl->file, dl->line);
-			continue;
-		} else if ( ! limit_match(d, lq))
-			continue;
-
-		/* Look up in hashtable. */
+}
 
-		if (NULL == d->fprint) {
-			warnx("%s:%zu: no <fingerprint>",
-				d->log->file, d->line);
-			continue;
-		}
+/*
+ * Finish output, if any, and free our fingerprints.
+ */
+static void
+print_close(struct find *fp)
+{
 
-		idx = jhash(d->fprint) % htabsz;
-		if (NULL == htab[idx]) {
-			htab[idx] = calloc
-				(1, sizeof(struct dive *));
-			if (NULL == htab[idx])
-				err(EXIT_FAILURE, NULL);
-		} 
+	if (NULL == fp->dl)
+		return;
+	if (NULL == fp->out) {
+		divecmd_print_diveq_close(stdout);
+		divecmd_print_close(stdout);
+	}
+	divecmd_fpset_free(&fp->seen);
+}
 
-		for (i = 0; NULL != htab[idx][i]; i++)
-			if (0 == strcmp
-			    (htab[idx][i]->fprint, d->fprint))
-				break;
-
-		if (NULL != htab[idx][i]) {
-			warnx("%s:%zu: duplicate dive from "
-				"%s:%zu", d->log->file, 
-				d->line, 
-				htab[idx][i]->log->file,
-				htab[idx][i]->line);
-			continue;
-		} 
+/*
+ * Print a single dive either to its own file or as part of the output.
+ * It must be from the same divelog (i.e., dive computer) as the first
+ * dive, however, and its fingerprint must also be unique.
+ */
+static void
+print_dive(struct find *fp, const struct dive *d)
+{
+	const struct fpseen *se;
+	FILE		*f = stdout;
+
+	if ( ! dlogeq(fp->dl, d->log)) {
+		warnx("%s:%zu: dive has mismatched "
+			"computer (from %s:%zu)",
+			d->log->file, d->line, 
+			fp->dl->file, fp->dl->line);
+		return;
+	} else if ( ! limit_match(fp->lq, 
+	    d->datetime, d->pid, d->mode))
+		return;
+
+	/* 
+	 * Look up in (and add to) our fingerprints.
+	 * These are copied, as the dive may be freed.
+	 */
 
-		/* Add to hash line. */
+	if (NULL == d->fprint) {
+		warnx("%s:%zu: no <fingerprint>",
+			d->log->file, d->line);
+		return;
+	}
 
-		htab[idx] = reallocarray
-			(htab[idx], i + 2, sizeof(struct dive *));
-		if (NULL == htab[idx])
-			err(EXIT_FAILURE, NULL);
-		htab[idx][i] = d;
-		htab[idx][i + 1] = NULL;
+	if (NULL != (se = divecmd_fpset_add(&fp->seen, d))) {
+		warnx("%s:%zu: duplicate dive from "
+			"%s:%zu", d->log->file, 
+			d->line, se->log->file,
+			se->line);
+		return;
+	} 
 
-		/* Print dive. */
+	/* Print dive. */
 
-		if (NULL != out) {
-			f = file_open(d, out);
-			divecmd_print_open(f, d->log);
-			divecmd_print_diveq_open(f);
-		}
-		divecmd_print_dive(f, d);
-		if (NULL != out) {
-			divecmd_print_diveq_close(f);
-			divecmd_print_close(f);
-			fclose(f);
-			f = stdout;
-		}
+	if (NULL != fp->out) {
+		f = file_open(d, fp->out);
+		divecmd_print_open(f, d->log);
+		divecmd_print_diveq_open(f);
 	}
-	if (NULL == out) {
+	divecmd_print_dive(f, d);
+	if (NULL != fp->out) {
 		divecmd_print_diveq_close(f);
 		divecmd_print_close(f);
+		fclose(f);
 	}
-	for (i = 0; i < htabsz; i++)
-		free(htab[i]);
-	free(htab);
+}
+
+/*
+ * Take all input files and either split or join them.
+ */
+static int
+print_all(struct find *fp, const struct diveq *dq)
+{
+	const struct dive *d;
+	
+	TAILQ_FOREACH(d, dq, entries)
+		if (0 == d->datetime) {
+			warnx("%s:%zu: no <dive> timestamp",
+				d->log->file, d->line);
+			return 0;
+		}
 
+	assert(NULL != TAILQ_FIRST(dq));
+	print_open(fp, TAILQ_FIRST(dq));
+	TAILQ_FOREACH(d, dq, entries)
+		print_dive(fp, d);
 	return 1;
 }
 
+/*
+ * Streaming callback: print and release each dive as it's parsed.
+ * The first dive's divelog is used for all output.
+ * An undated dive fails as it would without streaming, but the dives
+ * before it have already been printed: print_close() still finishes
+ * the document, so the output stays well-formed.
+ */
+static int
+stream_dive(struct dive *d, void *arg)
+{
+	struct find	*fp = arg;
+
+	if (0 == d->datetime) {
+		warnx("%s:%zu: no <dive> timestamp",
+			d->log->file, d->line);
+		return -1;
+	}
+	if (NULL == fp->dl)
+		print_open(fp, d);
+	print_dive(fp, d);
+	return 0;
+}
+
 static int
 limit_parse(const char *arg, struct limits *l)
 {
 	const char 	*obj, *cp;
+	struct dtcache	 dc;
 	struct tm	 tm;
-	struct tm	*tmp;
 	time_t		 t;
 	const char	*er = NULL;
 
@@ -314,13 +339,15 @@ limit_parse(const char *arg, struct limits *l)
 		return 0;
 	}
 
+	memset(&dc, 0, sizeof(struct dtcache));
+
 	switch (l->type) {
 	case LIMIT_DATETIME_AFTER:
 	case LIMIT_DATETIME_BEFORE:
 		memset(&tm, 0, sizeof(struct tm));
 		cp = strptime(obj, "%Y-%m-%dT%R", &tm);
 		if (NULL != cp && '\0' == *cp) {
-			l->date = mktime(&tm);
+			l->date = divecmd_mktime(&dc, &tm);
 			break;
 		}
 		warnx("-l: bad datetime: %s", obj);
@@ -330,23 +357,21 @@ limit_parse(const char *arg, struct limits *l)
 	case LIMIT_DATE_BEFORE:
 		if (0 == strcasecmp(obj, "today")) {
 			t = time(NULL);
-			tmp = localtime(&t);
-			tmp->tm_sec = tmp->tm_min =
-				tmp->tm_hour = 0;
-			l->date = mktime(tmp);
+			divecmd_localtime(&dc, t, &tm);
+			tm.tm_sec = tm.tm_min = tm.tm_hour = 0;
+			l->date = divecmd_mktime(&dc, &tm);
 			break;
 		} else if (0 == strcasecmp(obj, "yesterday")) {
 			t = time(NULL) - 60 * 60 * 24;
-			tmp = localtime(&t);
-			tmp->tm_sec = tmp->tm_min =
-				tmp->tm_hour = 0;
-			l->date = mktime(tmp);
+			divecmd_localtime(&dc, t, &tm);
+			tm.tm_sec = tm.tm_min = tm.tm_hour = 0;
+			l->date = divecmd_mktime(&dc, &tm);
 			break;
 		}
 		memset(&tm, 0, sizeof(struct tm));
 		cp = strptime(obj, "%Y-%m-%d", &tm);
 		if (NULL != cp && '\0' == *cp) {
-			l->date = mktime(&tm);
+			l->date = divecmd_mktime(&dc, &tm);
 			break;
 		}
 		warnx("-l: bad date: %s", obj);
@@ -383,23 +408,25 @@ limit_parse(const char *arg, struct limits *l)
 int
 main(int argc, char *argv[])
 {
-	int		 c, rc = 1;
-	size_t		 i;
+	int		 c, rc = 1, stream = 0;
 	XML_Parser	 p;
 	struct diveq	 dq;
 	struct divestat	 st;
-	const char	*out = NULL;
 	struct limitq	 limits;
 	struct limits	*l, tmp;
+	struct find	 fp;
+	size_t		 i;
 
 	TAILQ_INIT(&limits);
+	memset(&fp, 0, sizeof(struct find));
+	fp.lq = &limits;
 
 #if HAVE_PLEDGE
 	if (-1 == pledge("stdio rpath wpath cpath", NULL))
 		err(EXIT_FAILURE, "pledge");
 #endif
 
-	while (-1 != (c = getopt(argc, argv, "jl:o:sv")))
+	while (-1 != (c = getopt(argc, argv, "jl:o:suv")))
 		switch (c) {
 		case 'l':
 			if ( ! limit_parse(optarg, &tmp))
@@ -411,7 +438,10 @@ main(int argc, char *argv[])
 			TAILQ_INSERT_TAIL(&limits, l, entries);
 			break;
 		case 'o': /* XXX: undocumented */
-			out = optarg;
+			fp.out = optarg;
+			break;
+		case 'u':
+			stream = 1;
 			break;
 		case 'v':
 			verbose = 1;
@@ -424,17 +454,26 @@ main(int argc, char *argv[])
 	argv += optind;
 
 	divecmd_init(&p, &dq, &st, 
-		GROUP_NONE, GROUPSORT_DATETIME);
-
-	if (0 == argc)
+		GROUP_NONE, GROUPSORT_DATETIME, WANT_ALL);
+
+	if (stream && 0 == argc)
+		rc = divecmd_parse_stream("-", p, 
+			&dq, &st, stream_dive, &fp);
+	else if (stream)
+		for (i = 0; i < (size_t)argc && rc; i++)
+			rc = divecmd_parse_stream(argv[i], p, 
+				&dq, &st, stream_dive, &fp);
+	else if (0 == argc)
 		rc = divecmd_parse("-", p, &dq, &st);
-
-	for (i = 0; i < (size_t)argc; i++)
-		if ( ! (rc = divecmd_parse(argv[i], p, &dq, &st)))
-			break;
+	else if ( ! TAILQ_EMPTY(&limits))
+		rc = divecmd_parse_select((const char *const *)argv, 
+			argc, &dq, &st, select_dive, &limits);
+	else
+		rc = divecmd_parse_many((const char *const *)argv, 
+			argc, &dq, &st);
 
 #if HAVE_PLEDGE
-	if (NULL == out) {
+	if (NULL == fp.out) {
 		if (-1 == pledge("stdio", NULL))
 			err(EXIT_FAILURE, "pledge");
 	} else {
@@ -446,14 +485,16 @@ main(int argc, char *argv[])
 	if ( ! rc)
 		goto out;
 
-	if (TAILQ_EMPTY(&dq)) {
+	if (TAILQ_EMPTY(&dq) && NULL == fp.dl) {
 		warnx("no dives to display");
 		goto out;
 	}
 
-	rc = print_all(out, &limits, &dq);
+	if ( ! stream)
+		rc = print_all(&fp, &dq);
 
 out:
+	print_close(&fp);
 	while (NULL != (l = TAILQ_FIRST(&limits))) {
 		TAILQ_REMOVE(&limits, l, entries);
 		free(l);
@@ -467,7 +508,7 @@ usage:
 		free(l);
 	}
 	fprintf(stderr, "usage: %s "
-		"[-v] [-l limit] "
+		"[-uv] [-l limit] "
 		"[file ...]\n", getprogname());
 	return EXIT_FAILURE;
 }
@@ -24,9 +24,11 @@
 #endif
 #include <float.h>
 #include <math.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <expat.h>
@@ -108,8 +110,8 @@ print_all(enum pmode mode, const struct diveq *dq, int first,
 	const struct divestat *st, const char *title)
 {
 	struct dive	*d, *dp;
-	struct samp	*s;
-	size_t		 i = 0, j, maxtime = 0, maxrtime = 0, 
+	const struct sampcols *c;
+	size_t		 i = 0, j, k, maxtime = 0, maxrtime = 0, 
 			 ndives = 0, free = 0, rest, maxdtime = 0;
 	time_t		 t, lastt = 0;
 	double		 maxdepth = 0.0, lastdepth, x, y, 
@@ -562,19 +564,20 @@ print_all(enum pmode mode, const struct diveq *dq, int first,
 				x = (d->datetime - dg->mintime) /
 					(double)maxtime;
 				printf("%g 0\n", x);
-				TAILQ_FOREACH(s, &d->samps, entries) {
-					if ( ! (SAMP_DEPTH & s->flags))
+				c = &d->cols;
+				for (k = 0; k < c->sz; k++) {
+					if ( ! (SAMP_DEPTH & c->flags[k]))
 						continue;
-					t = s->time;
+					t = c->time[k];
 					t += d->datetime;
 					t -= dg->mintime;
 					x = t / (double)maxtime;
-					y = (0 == derivs) ? -s->depth :
+					y = (0 == derivs) ? -c->depth[k] :
 						(lastt == t) ? 0.0 :
-						(lastdepth - s->depth) /
+						(lastdepth - c->depth[k]) /
 						(t - lastt);
 					printf("%g %g\n", x, y);
-					lastdepth = s->depth;
+					lastdepth = c->depth[k];
 					lastt = t;
 				}
 				x = lastt / (double)maxtime;
@@ -589,14 +592,15 @@ print_all(enum pmode mode, const struct diveq *dq, int first,
 				cols[dg->id % COL_MAX],
 				LINE_THICKNESS);
 			TAILQ_FOREACH(d, &dg->dives, gentries) {
-				TAILQ_FOREACH(s, &d->samps, entries) {
-					if ( ! (SAMP_TEMP & s->flags))
+				c = &d->cols;
+				for (k = 0; k < c->sz; k++) {
+					if ( ! (SAMP_TEMP & c->flags[k]))
 						continue;
-					t = s->time;
+					t = c->time[k];
 					t += d->datetime;
 					t -= dg->mintime;
 					x = t / (double)maxtime;
-					y = s->temp;
+					y = c->temp[k];
 					printf("%g %g\n", x, y);
 				}
 			}
@@ -640,12 +644,13 @@ print_all(enum pmode mode, const struct diveq *dq, int first,
 				cols[dg->id % COL_MAX],
 				LINE_THICKNESS);
 			TAILQ_FOREACH(d, &dg->dives, gentries) {
-				TAILQ_FOREACH(s, &d->samps, entries) {
-					if ( ! (SAMP_TEMP & s->flags))
+				c = &d->cols;
+				for (k = 0; k < c->sz; k++) {
+					if ( ! (SAMP_TEMP & c->flags[k]))
 						continue;
-					t = s->time;
+					t = c->time[k];
 					x = t / (double)maxtime;
-					y = s->temp;
+					y = c->temp[k];
 					printf("%g %g\n", x, y);
 				}
 				if (TAILQ_NEXT(d, gentries))
@@ -713,17 +718,18 @@ print_all(enum pmode mode, const struct diveq *dq, int first,
 			TAILQ_FOREACH(d, &dg->dives, gentries) {
 				puts("0 0");
 				lastdepth = 0.0;
-				TAILQ_FOREACH(s, &d->samps, entries) {
-					if ( ! (SAMP_DEPTH & s->flags))
+				c = &d->cols;
+				for (k = 0; k < c->sz; k++) {
+					if ( ! (SAMP_DEPTH & c->flags[k]))
 						continue;
-					t = s->time;
+					t = c->time[k];
 					x = t / (double)maxtime;
-					y = 0 == derivs ? -s->depth :
+					y = 0 == derivs ? -c->depth[k] :
 						lastt == t ? 0.0 :
-						(lastdepth - s->depth) /
+						(lastdepth - c->depth[k]) /
 						(t - lastt);
 					printf("%g %g\n", x, y);
-					lastdepth = s->depth;
+					lastdepth = c->depth[k];
 					lastt = t;
 				}
 				x = lastt / (double)maxtime;
@@ -744,7 +750,6 @@ main(int argc, char *argv[])
 {
 	int		 c, rc = 1, first;
 	enum group	 group = GROUP_NONE;
-	size_t		 i;
 	XML_Parser	 p;
 	struct diveq	 dq;
 	struct divestat	 st;
@@ -753,7 +758,8 @@ main(int argc, char *argv[])
 	/* Pledge us early: only reading files. */
 
 #if HAVE_PLEDGE
-	if (-1 == pledge("stdio rpath", NULL))
+	if (-1 == pledge(NULL == getenv("DCMD_CACHE") ?
+	    "stdio rpath" : "stdio rpath wpath cpath", NULL))
 		err(EXIT_FAILURE, "pledge");
 #endif
 	while (-1 != (c = getopt(argc, argv, "adm:s:v")))
@@ -806,7 +812,9 @@ main(int argc, char *argv[])
 	     MODE__MAX != mode))
 		warnx("-a: ignoring flag");
 
-	divecmd_init(&p, &dq, &st, group, GROUPSORT_DATETIME);
+	divecmd_init(&p, &dq, &st, group, GROUPSORT_DATETIME,
+		SAMP_DEPTH | SAMP_TEMP);
+	st.compact = 1;
 
 	/* 
 	 * Handle all files or stdin.
@@ -815,10 +823,9 @@ main(int argc, char *argv[])
 
 	if (0 == argc)
 		rc = divecmd_parse("-", p, &dq, &st);
-
-	for (i = 0; i < (size_t)argc; i++)
-		if ( ! (rc = divecmd_parse(argv[i], p, &dq, &st)))
-			break;
+	else
+		rc = divecmd_parse_many((const char *const *)argv, 
+			argc, &dq, &st);
 
 #if HAVE_PLEDGE
 	if (-1 == pledge("stdio", NULL))
@@ -22,9 +22,11 @@
 #if HAVE_ERR
 # include <err.h>
 #endif
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <expat.h>
@@ -35,46 +37,86 @@ int verbose = 0;
 
 static int aggr = 0;
 
+/*
+ * State for printing dives as they're parsed.
+ */
+struct	stream {
+	const struct dgroup *dg; /* group of last dive or NULL */
+	size_t		 ndives; /* dives printed */
+};
+
+static void
+print_open(void)
+{
+
+	puts("{\"divecmd2json\":");
+	puts("\t{\"version\": \"" VERSION "\",");
+	puts("\t \"divers\": [");
+}
+
+static void
+print_close(void)
+{
+
+	puts("\t ]}");
+	puts("}");
+}
+
+static void
+print_group_open(const struct dgroup *dg)
+{
+
+	printf("\t\t{\"ident\": \"%s\",\n",
+		NULL == dg->name ?  "" : dg->name);
+	printf("\t\t \"dives\": [\n");
+}
+
+/*
+ * Print a dive, less its closing brace.
+ */
+static void
+print_dive(const struct divestat *st, const struct dive *d)
+{
+	const struct sampcols *c = &d->cols;
+	size_t		 i;
+	time_t		 t;
+
+	printf("\t\t\t{\"num\": %zu,\n", d->num);
+	if (0 != d->datetime)
+		printf("\t\t\t \"datetime\": %lld,\n", 
+			(long long)d->datetime);
+	puts("\t\t\t \"samples\": [");
+	for (i = 0; i < c->sz; i++) {
+		t = c->time[i];
+		if (aggr) {
+			t += d->datetime;
+			t -= st->timestamp_min;
+		}
+		printf("\t\t\t\t{\"time\": %lld", 
+			(long long)t);
+		if (SAMP_DEPTH & c->flags[i])
+			printf(", \"depth\": %g", c->depth[i]);
+		if (SAMP_TEMP & c->flags[i])
+			printf(", \"temp\": %g", c->temp[i]);
+		printf("}%s\n", i + 1 < c->sz ? "," : "");
+	}
+	puts("\t\t\t\t]");
+}
+
 static void
 print_all(const struct divestat *st)
 {
 	struct dive	*d;
 	struct dgroup	*dg;
-	struct samp	*s;
-	time_t		 t;
 	size_t		 i;
 
-	puts("{\"divecmd2json\":");
-	puts("\t{\"version\": \"" VERSION "\",");
-	puts("\t \"divers\": [");
+	print_open();
 
 	for (i = 0; i < st->groupsz; i++) {
 		dg = st->groups[i];
-		printf("\t\t{\"ident\": \"%s\",\n",
-			NULL == dg->name ?  "" : dg->name);
-		printf("\t\t \"dives\": [\n");
+		print_group_open(dg);
 		TAILQ_FOREACH(d, &dg->dives, gentries) {
-			printf("\t\t\t{\"num\": %zu,\n", d->num);
-			if (0 != d->datetime)
-				printf("\t\t\t \"datetime\": %lld,\n", 
-					(long long)d->datetime);
-			puts("\t\t\t \"samples\": [");
-			TAILQ_FOREACH(s, &d->samps, entries) {
-				t = s->time;
-				if (aggr) {
-					t += d->datetime;
-					t -= st->timestamp_min;
-				}
-				printf("\t\t\t\t{\"time\": %lld", 
-					(long long)t);
-				if (SAMP_DEPTH & s->flags)
-					printf(", \"depth\": %g", s->depth);
-				if (SAMP_TEMP & s->flags)
-					printf(", \"temp\": %g", s->temp);
-				printf("}%s\n", 
-					TAILQ_NEXT(s, entries) ? "," : "");
-			}
-			puts("\t\t\t\t]");
+			print_dive(st, d);
 			if (TAILQ_NEXT(d, gentries)) 
 				puts("\t\t\t},");
 			else
@@ -82,28 +124,71 @@ print_all(const struct divestat *st)
 		}
 		printf("\t\t}%s\n", i < st->groupsz - 1 ? "," : "");
 	}
-	puts("\t ]}");
-	puts("}");
+
+	print_close();
+}
+
+/*
+ * Streaming callback: print and release each dive as it's parsed.
+ * A diver's dives are printed together only if they're consecutive in
+ * the input: otherwise the diver is listed again.
+ */
+static int
+stream_dive(struct dive *d, void *arg)
+{
+	struct stream	*sp = arg;
+
+	if (NULL == sp->dg)
+		print_open();
+	if (d->group != sp->dg) {
+		if (NULL != sp->dg) {
+			puts("\t\t\t}]");
+			puts("\t\t},");
+		}
+		print_group_open(d->group);
+		sp->dg = d->group;
+	} else
+		puts("\t\t\t},");
+
+	print_dive(NULL, d);
+	sp->ndives++;
+	return 0;
+}
+
+static void
+stream_close(const struct stream *sp)
+{
+
+	if (NULL == sp->dg)
+		return;
+	puts("\t\t\t}]");
+	puts("\t\t}");
+	print_close();
 }
 
 int
 main(int argc, char *argv[])
 {
-	int		 c, rc = 1;
-	size_t		 i;
+	int		 c, rc = 1, stream = 0;
 	XML_Parser	 p;
 	struct diveq	 dq;
 	struct divestat	 st;
+	struct stream	 sp;
+	size_t		 i;
 
 #if HAVE_PLEDGE
-	if (-1 == pledge("stdio rpath", NULL))
+	if (-1 == pledge(NULL == getenv("DCMD_CACHE") ?
+	    "stdio rpath" : "stdio rpath wpath cpath", NULL))
 		err(EXIT_FAILURE, "pledge");
 #endif
-	while (-1 != (c = getopt(argc, argv, "av")))
+	while (-1 != (c = getopt(argc, argv, "auv")))
 		switch (c) {
 		case ('a'):
 			aggr = 1;
 			break;
+		case ('u'):
+			stream = 1;
+			break;
 		case ('v'):
 			verbose = 1;
 			break;
@@ -114,14 +199,28 @@ main(int argc, char *argv[])
 	argc -= optind;
 	argv += optind;
 
-	divecmd_init(&p, &dq, &st, GROUP_DIVER, GROUPSORT_DATETIME);
+	/* Aggregate times need the earliest dive up front. */
 
-	if (0 == argc)
-		rc = divecmd_parse("-", p, &dq, &st);
+	if (aggr && stream)
+		goto usage;
 
-	for (i = 0; i < (size_t)argc; i++)
-		if ( ! (rc = divecmd_parse(argv[i], p, &dq, &st)))
-			break;
+	divecmd_init(&p, &dq, &st, GROUP_DIVER, GROUPSORT_DATETIME,
+		SAMP_DEPTH | SAMP_TEMP);
+	st.compact = 1;
+	memset(&sp, 0, sizeof(struct stream));
+
+	if (stream && 0 == argc)
+		rc = divecmd_parse_stream("-", p, 
+			&dq, &st, stream_dive, &sp);
+	else if (stream)
+		for (i = 0; i < (size_t)argc && rc; i++)
+			rc = divecmd_parse_stream(argv[i], p, 
+				&dq, &st, stream_dive, &sp);
+	else if (0 == argc)
+		rc = divecmd_parse("-", p, &dq, &st);
+	else
+		rc = divecmd_parse_many((const char *const *)argv, 
+			argc, &dq, &st);
 
 #if HAVE_PLEDGE
 	if (-1 == pledge("stdio", NULL))
@@ -130,18 +229,21 @@ main(int argc, char *argv[])
 
 	XML_ParserFree(p);
 
+	if (stream)
+		stream_close(&sp);
 	if ( ! rc)
 		goto out;
-	if (TAILQ_EMPTY(&dq)) {
+	if (TAILQ_EMPTY(&dq) && 0 == sp.ndives) {
 		warnx("no dives to display");
 		goto out;
 	}
 
-	print_all(&st);
+	if ( ! stream)
+		print_all(&st);
 out:
 	divecmd_free(&dq, &st);
 	return(rc ? EXIT_SUCCESS : EXIT_FAILURE);
 usage:
-	fprintf(stderr, "usage: %s [-av] [file]\n", getprogname());
+	fprintf(stderr, "usage: %s [-a | -u] [-v] [file]\n", getprogname());
 	return(EXIT_FAILURE);
 }
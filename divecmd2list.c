@@ -22,6 +22,7 @@
 #if HAVE_ERR
 # include <err.h>
 #endif
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -60,12 +61,14 @@ print_divelog(const struct dlog *dl)
 static void
 print_datetime(const struct dive *d)
 {
-	struct tm	*tm = localtime(&d->datetime);
+	static struct dtcache dc;
+	struct tm	 tm;
 
+	divecmd_localtime(&dc, d->datetime, &tm);
 	printf("%04d-%02d-%02d %02d:%02d:%02d  ",
-		tm->tm_year + 1900, tm->tm_mon + 1, 
-		tm->tm_mday, tm->tm_hour, tm->tm_min, 
-		tm->tm_sec);
+		tm.tm_year + 1900, tm.tm_mon + 1, 
+		tm.tm_mday, tm.tm_hour, tm.tm_min, 
+		tm.tm_sec);
 }
 
 static void
@@ -96,26 +99,17 @@ print_all(int human, const struct divestat *ds)
 {
 	const struct dgroup	*dg;
 	const struct dive	*d;
-	const struct samp	*s;
-	size_t			 i, tempsz;
-	double			 temp;
+	size_t			 i;
 
 	for (i = 0; i < ds->groupsz; i++) {
 		dg = ds->groups[i];
 		print_divelog(TAILQ_FIRST(&dg->dives)->log);
 		TAILQ_FOREACH(d, &dg->dives, gentries) {
-			tempsz = 0;
-			temp = 0.0;
-			TAILQ_FOREACH(s, &d->samps, entries)
-				if (SAMP_TEMP & s->flags) {
-					temp += s->temp;
-					tempsz++;
-				}
 			printf("  %5zu  ", d->pid);
 			print_datetime(d);
 			printf("%5.2f  ", d->maxdepth);
-			if (tempsz > 0)
-				printf("%5.1f  ", temp / tempsz);
+			if (d->ntemps > 0)
+				printf("%5.1f  ", d->sumtemp / d->ntemps);
 			else
 				fputs("    -  ", stdout);
 			print_duration(human, d);
@@ -139,13 +133,13 @@ main(int argc, char *argv[])
 	int		 c, rc = 1, human = 1;
 	const char	*sort = NULL;
 	enum groupsort	 gsort;
-	size_t		 i;
 	XML_Parser	 p;
 	struct diveq	 dq;
 	struct divestat	 st;
 
 #if HAVE_PLEDGE
-	if (-1 == pledge("stdio rpath", NULL))
+	if (-1 == pledge(NULL == getenv("DCMD_CACHE") ?
+	    "stdio rpath" : "stdio rpath wpath cpath", NULL))
 		err(EXIT_FAILURE, "pledge");
 #endif
 
@@ -184,14 +178,15 @@ main(int argc, char *argv[])
 	else
 		goto usage;
 
-	divecmd_init(&p, &dq, &st, GROUP_DIVELOG, gsort);
+	divecmd_init(&p, &dq, &st, GROUP_DIVELOG, gsort,
+		SAMP_DEPTH | SAMP_TEMP);
+	st.summary = 1;
 
 	if (0 == argc)
 		rc = divecmd_parse("-", p, &dq, &st);
-
-	for (i = 0; i < (size_t)argc; i++)
-		if ( ! (rc = divecmd_parse(argv[i], p, &dq, &st)))
-			break;
+	else
+		rc = divecmd_parse_many((const char *const *)argv, 
+			argc, &dq, &st);
 
 #if HAVE_PLEDGE
 	if (-1 == pledge("stdio", NULL))
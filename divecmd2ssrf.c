@@ -23,6 +23,7 @@
 # include <err.h>
 #endif
 #include <float.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -188,12 +189,15 @@ print_all(const struct dlog *dl,
 {
 	const struct dive *d;
 	const struct samp *s;
-	struct tm	  *tm;
+	struct dtcache	   dc;
+	struct tm	   tm;
 	size_t		   i, j, cylsz;
 	size_t		  *map_cyl, *map_gas;
 	unsigned int	   bits;
 	int		   in_deco;
 
+	memset(&dc, 0, sizeof(struct dtcache));
+
 	puts("<divelog program=\'dcmd2ssrf\' "
 	     " version=\'" VERSION "\'>\n"
 	     " <settings>");
@@ -212,13 +216,13 @@ print_all(const struct dlog *dl,
 
 		printf("  <dive number='%zu'", d->num);
 		if (d->datetime) {
-			tm = localtime(&d->datetime);
+			divecmd_localtime(&dc, d->datetime, &tm);
 			printf(" date='%.4d-%.2d-%.2d'"
 			       " time='%.2d:%.2d:%.2d'",
-			       tm->tm_year + 1900, 
-			       tm->tm_mon + 1, tm->tm_mday,
-			       tm->tm_hour, tm->tm_min,
-			       tm->tm_sec);
+			       tm.tm_year + 1900, 
+			       tm.tm_mon + 1, tm.tm_mday,
+			       tm.tm_hour, tm.tm_min,
+			       tm.tm_sec);
 		}
 		if (d->duration)
 			printf(" duration='%zu:%.2zu min'",
@@ -388,14 +392,14 @@ int
 main(int argc, char *argv[])
 {
 	int		 c, rc = 1;
-	size_t		 i;
 	XML_Parser	 p;
 	struct diveq	 dq;
 	struct divestat	 st;
 	const char	*deviceid = NULL;
 
 #if HAVE_PLEDGE
-	if (-1 == pledge("stdio rpath", NULL))
+	if (-1 == pledge(NULL == getenv("DCMD_CACHE") ?
+	    "stdio rpath" : "stdio rpath wpath cpath", NULL))
 		err(EXIT_FAILURE, "pledge");
 #endif
 	while (-1 != (c = getopt(argc, argv, "i:v")))
@@ -414,13 +418,13 @@ main(int argc, char *argv[])
 	argv += optind;
 
 	divecmd_init(&p, &dq, &st, 
-		GROUP_DIVELOG, GROUPSORT_DATETIME);
+		GROUP_DIVELOG, GROUPSORT_DATETIME, WANT_ALL);
 
 	if (0 == argc)
 		rc = divecmd_parse("-", p, &dq, &st);
-	for (i = 0; i < (size_t)argc; i++)
-		if ( ! (rc = divecmd_parse(argv[i], p, &dq, &st)))
-			break;
+	else
+		rc = divecmd_parse_many((const char *const *)argv, 
+			argc, &dq, &st);
 
 #if HAVE_PLEDGE
 	if (-1 == pledge("stdio", NULL))
@@ -26,6 +26,7 @@
 #include <float.h>
 #include <locale.h>
 #include <math.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <time.h>
@@ -372,21 +373,27 @@ static struct avg *
 collect(const struct dive *d, size_t cols, 
 	time_t mint, time_t maxt, enum grapht type)
 {
-	struct samp	*samp;
+	const struct sampcols *c = &d->cols;
+	const double	*v;
 	double		 frac;
-	size_t		 idx;
+	size_t		 i, idx;
+	unsigned int	 flag;
 	time_t		 t;
 	struct avg	*avg = NULL;
 
 	if (NULL == (avg = calloc(cols, sizeof(struct avg))))
 		err(EXIT_FAILURE, NULL);
 
-	TAILQ_FOREACH(samp, &d->samps, entries) {
-		if (GRAPH_DEPTH == type &&
-		    ! (SAMP_DEPTH & samp->flags))
-			continue;
-		if (GRAPH_TEMP == type &&
-		    ! (SAMP_TEMP & samp->flags))
+	if (GRAPH_DEPTH == type) {
+		flag = SAMP_DEPTH;
+		v = c->depth;
+	} else {
+		flag = SAMP_TEMP;
+		v = c->temp;
+	}
+
+	for (i = 0; i < c->sz; i++) {
+		if ( ! (flag & c->flags[i]))
 			continue;
 		
 		/*
@@ -395,16 +402,12 @@ collect(const struct dive *d, size_t cols,
 		 * Otherwise it's just between 0 and maxt.
 		 */
 
-		t = aggr ? (d->datetime + samp->time) - mint : 
-			samp->time;
+		t = aggr ? (d->datetime + c->time[i]) - mint : 
+			c->time[i];
 		frac = (double)t / (maxt - mint);
 		idx = floor(frac * (cols - 1));
 		assert(idx < cols);
-
-		if (GRAPH_DEPTH == type)
-			avg[idx].accum += samp->depth;
-		else if (GRAPH_TEMP == type)
-			avg[idx].accum += samp->temp;
+		avg[idx].accum += v[i];
 		avg[idx].sz++;
 	}
 
@@ -422,10 +425,10 @@ print_all(const struct diveq *dq, const struct winsize *ws)
 {
 	const struct dive *d;
 	struct graph	   temp, depth;
-	struct samp	  *samp;
+	const struct sampcols *c;
 	int		   dtemp = 0, ddepth = 0;
 	struct win	   win, iwin;
-	size_t		   i, lbuf, avgsz, tbuf, need;
+	size_t		   i, j, lbuf, avgsz, tbuf, need;
 	struct avg	 **avg;
 	time_t		   mint = 0, maxt = 0, t;
 
@@ -451,20 +454,21 @@ print_all(const struct diveq *dq, const struct winsize *ws)
 			continue;
 		}
 		avgsz++;
-		TAILQ_FOREACH(samp, &d->samps, entries) {
-			if (SAMP_DEPTH & samp->flags) {
+		c = &d->cols;
+		for (j = 0; j < c->sz; j++) {
+			if (SAMP_DEPTH & c->flags[j]) {
 				depth.nsamps++;
-				if (samp->depth > depth.maxvalue)
-					depth.maxvalue = samp->depth;
-				if (samp->depth < depth.minvalue)
-					depth.minvalue = samp->depth;
+				if (c->depth[j] > depth.maxvalue)
+					depth.maxvalue = c->depth[j];
+				if (c->depth[j] < depth.minvalue)
+					depth.minvalue = c->depth[j];
 			}
-			if (SAMP_TEMP & samp->flags) {
+			if (SAMP_TEMP & c->flags[j]) {
 				temp.nsamps++;
-				if (samp->temp > temp.maxvalue)
-					temp.maxvalue = samp->temp;
-				if (samp->temp < temp.minvalue)
-					temp.minvalue = samp->temp;
+				if (c->temp[j] > temp.maxvalue)
+					temp.maxvalue = c->temp[j];
+				if (c->temp[j] < temp.minvalue)
+					temp.minvalue = c->temp[j];
 			}
 		}
 	}
@@ -486,23 +490,26 @@ print_all(const struct diveq *dq, const struct winsize *ws)
 		TAILQ_FOREACH(d, dq, entries) {
 			if (0 == d->datetime)
 				continue;
-			TAILQ_FOREACH(samp, &d->samps, entries)
-				if (SAMP_TEMP & samp->flags ||
-				    SAMP_DEPTH & samp->flags) {
-					t = d->datetime + samp->time;
+			c = &d->cols;
+			for (j = 0; j < c->sz; j++)
+				if ((SAMP_TEMP | SAMP_DEPTH) & 
+				    c->flags[j]) {
+					t = d->datetime + c->time[j];
 					if (t > maxt)
 						maxt = t;
 				}
 		}
 	} else
-		TAILQ_FOREACH(d, dq, entries) 
-			TAILQ_FOREACH(samp, &d->samps, entries)
-				if (SAMP_DEPTH & samp->flags ||
-				    SAMP_TEMP & samp->flags) {
-					t = samp->time;
+		TAILQ_FOREACH(d, dq, entries) {
+			c = &d->cols;
+			for (j = 0; j < c->sz; j++)
+				if ((SAMP_DEPTH | SAMP_TEMP) & 
+				    c->flags[j]) {
+					t = c->time[j];
 					if (t > maxt)
 						maxt = t;
 				}
+		}
 
 	/*
 	 * Establish whether we should do any graphing at all for the
@@ -640,7 +647,6 @@ int
 main(int argc, char *argv[])
 {
 	int		 c, rc = 0;
-	size_t		 i;
 	XML_Parser	 p;
 	struct diveq	 dq;
 	struct divestat	 st;
@@ -659,7 +665,8 @@ main(int argc, char *argv[])
 	}
 
 #if HAVE_PLEDGE
-	if (-1 == pledge("stdio rpath", NULL))
+	if (-1 == pledge(NULL == getenv("DCMD_CACHE") ?
+	    "stdio rpath" : "stdio rpath wpath cpath", NULL))
 		err(EXIT_FAILURE, "pledge");
 #endif
 
@@ -688,14 +695,14 @@ main(int argc, char *argv[])
 	argv += optind;
 
 	divecmd_init(&p, &dq, &st, 
-		GROUP_NONE, GROUPSORT_DATETIME);
+		GROUP_NONE, GROUPSORT_DATETIME, SAMP_DEPTH | SAMP_TEMP);
+	st.compact = 1;
 
 	if (0 == argc)
 		rc = divecmd_parse("-", p, &dq, &st);
-
-	for (i = 0; i < (size_t)argc; i++)
-		if ( ! (rc = divecmd_parse(argv[i], p, &dq, &st)))
-			break;
+	else
+		rc = divecmd_parse_many((const char *const *)argv, 
+			argc, &dq, &st);
 
 #if HAVE_PLEDGE
 	if (-1 == pledge("stdio", NULL))
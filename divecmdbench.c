@@ -0,0 +1,342 @@
+/*	$Id$ */
+/*
+ * Copyright (c) 2017 Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include "config.h"
+
+#include <sys/queue.h>
+#include <sys/stat.h>
+
+#if HAVE_ERR
+# include <err.h>
+#endif
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <expat.h>
+
+#include "parser.h"
+
+/*
+ * Benchmarks (and checks) for the parser's hot paths, run over real
+ * sample files by "make bench": the parse loop's CPU time per MB,
+ * element and attribute name lookup, and number conversion.
+ * This isn't installed.
+ */
+
+int verbose = 0;
+
+/*
+ * Numbers that the fast path of divecmd_strtod() must either get
+ * exactly right or hand to strtod(3).
+ */
+static	const char *const edges[] = {
+	"", "-", "+", ".", "-.", "+.", "0", "-0", "+0", "-0.0", "0.",
+	"12.", "-12.", "+12.", ".5", "-.5", "+1.5", "+0.25",
+	"12.34", "-1.5", "007", "1.50000",
+	"123456789012345", "12345678901234.5", "-1.23456789012345",
+	"1234567890123456", "1.234567890123456", "99999999999999999999",
+	"0.000000000000001", "0.0000000000000001",
+	"1e3", "1E3", "-1.5e-3", "1.e5", "1e", "1e+", "2.5E+10",
+	"0x10", "0X1p3", "inf", "-inf", "nan", "infinity",
+	" 3.5", "\t-2", "3.5 ", "3.5x", "1,5", "1.5q", "--1", "+-1",
+	"1.2.3",
+	NULL
+};
+
+/*
+ * Compare divecmd_strtod() with strtod(3) on "s": the values must be
+ * bit-identical (so "-0" stays negative) and the end pointers equal.
+ * Returns zero (after warning) on mismatch, non-zero otherwise.
+ */
+static int
+check_one(const char *s)
+{
+	double	 v1, v2;
+	char	*ep1, *ep2;
+
+	v1 = strtod(s, &ep1);
+	v2 = divecmd_strtod(s, &ep2);
+	if (0 == memcmp(&v1, &v2, sizeof(double)) && ep1 == ep2)
+		return 1;
+	warnx("\"%s\": strtod %.17g (end %td), "
+		"divecmd_strtod %.17g (end %td)",
+		s, v1, ep1 - s, v2, ep2 - s);
+	return 0;
+}
+
+/*
+ * Read all of "fname" into a nil-terminated buffer.
+ * Exits on failure.
+ */
+static char *
+file_read(const char *fname, size_t *sz)
+{
+	struct stat	 st;
+	char		*buf;
+	ssize_t		 ssz;
+	size_t		 off;
+	int		 fd;
+
+	if (-1 == (fd = open(fname, O_RDONLY, 0)))
+		err(EXIT_FAILURE, "%s", fname);
+	if (-1 == fstat(fd, &st))
+		err(EXIT_FAILURE, "%s", fname);
+	if (NULL == (buf = malloc(st.st_size + 1)))
+		err(EXIT_FAILURE, NULL);
+	for (off = 0; off < (size_t)st.st_size; off += ssz)
+		if (-1 == (ssz = read(fd, buf + off, st.st_size - off)))
+			err(EXIT_FAILURE, "%s", fname);
+		else if (0 == ssz)
+			errx(EXIT_FAILURE, "%s: short read", fname);
+	close(fd);
+	buf[off] = '\0';
+	*sz = off;
+	return buf;
+}
+
+/*
+ * Collect the value="..." attributes of "buf" (as written by dcmd for
+ * every depth, temperature, pressure and so on) into "vals", each
+ * nil-terminated in place.
+ */
+static void
+vals_add(char *buf, char ***vals, size_t *valsz, size_t *valmax)
+{
+	char	*cp, *end;
+
+	for (cp = buf; NULL != (cp = strstr(cp, "value=\"")); cp = end) {
+		cp += 7;
+		if (NULL == (end = strchr(cp, '"')))
+			break;
+		*end++ = '\0';
+		if (*valsz == *valmax) {
+			*valmax = 0 == *valmax ? 1024 : *valmax * 2;
+			*vals = reallocarray(*vals,
+				*valmax, sizeof(char *));
+			if (NULL == *vals)
+				err(EXIT_FAILURE, NULL);
+		}
+		(*vals)[(*valsz)++] = cp;
+	}
+}
+
+static double
+now(void)
+{
+	struct timespec	 ts;
+
+	if (-1 == clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts))
+		err(EXIT_FAILURE, "clock_gettime");
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Time "fn" over all "vals", repeated until at least half a second has
+ * passed, and return the nanoseconds per value.
+ */
+static double
+bench_strtod(double (*fn)(const char *, char **),
+	char *const *vals, size_t valsz)
+{
+	volatile double	 sink = 0.0;
+	double		 start, t;
+	size_t		 i, n = 0;
+
+	start = now();
+	do {
+		for (i = 0; i < valsz; i++)
+			sink += fn(vals[i], NULL);
+		n += valsz;
+	} while ((t = now() - start) < 0.5);
+
+	(void)sink;
+	return t * 1e9 / n;
+}
+
+/*
+ * Element and attribute names of a file, in document order, for timing
+ * divecmd_token().
+ */
+struct	names {
+	char		**names;
+	size_t		  namesz;
+	size_t		  namemax;
+};
+
+static void
+name_add(struct names *n, const XML_Char *s)
+{
+
+	if (n->namesz == n->namemax) {
+		n->namemax = 0 == n->namemax ? 1024 : n->namemax * 2;
+		n->names = reallocarray(n->names,
+			n->namemax, sizeof(char *));
+		if (NULL == n->names)
+			err(EXIT_FAILURE, NULL);
+	}
+	if (NULL == (n->names[n->namesz++] = strdup(s)))
+		err(EXIT_FAILURE, NULL);
+}
+
+static void
+names_open(void *dat, const XML_Char *s, const XML_Char **atts)
+{
+	struct names	*n = dat;
+
+	name_add(n, s);
+	for ( ; NULL != atts[0]; atts += 2)
+		name_add(n, atts[0]);
+}
+
+static void
+names_add(struct names *n, const char *fname, const char *buf, size_t sz)
+{
+	XML_Parser	 p;
+
+	if (NULL == (p = XML_ParserCreate(NULL)))
+		err(EXIT_FAILURE, NULL);
+	XML_SetUserData(p, n);
+	XML_SetStartElementHandler(p, names_open);
+	if (XML_STATUS_OK != XML_Parse(p, buf, sz, 1))
+		errx(EXIT_FAILURE, "%s: %s", fname,
+			XML_ErrorString(XML_GetErrorCode(p)));
+	XML_ParserFree(p);
+}
+
+/*
+ * Time divecmd_token() over all names like bench_strtod().
+ */
+static double
+bench_token(const struct names *n)
+{
+	volatile size_t	 sink = 0;
+	double		 start, t;
+	size_t		 i, num = 0;
+
+	start = now();
+	do {
+		for (i = 0; i < n->namesz; i++)
+			sink += divecmd_token(n->names[i]);
+		num += n->namesz;
+	} while ((t = now() - start) < 0.5);
+
+	(void)sink;
+	return t * 1e9 / num;
+}
+
+/*
+ * Time the full parse loop (divecmd_parse()) over "fname" of "sz"
+ * bytes, repeated until at least half a second has passed, and return
+ * the CPU milliseconds per MB.
+ */
+static double
+bench_parse(const char *fname, size_t sz)
+{
+	XML_Parser	 p;
+	struct diveq	 dq;
+	struct divestat	 st;
+	double		 start, t;
+	size_t		 n = 0;
+
+	start = now();
+	do {
+		divecmd_init(&p, &dq, &st, 
+			GROUP_NONE, GROUPSORT_DATETIME, WANT_ALL);
+		if ( ! divecmd_parse(fname, p, &dq, &st))
+			errx(EXIT_FAILURE, "%s: parse failed", fname);
+		XML_ParserFree(p);
+		divecmd_free(&dq, &st);
+		n++;
+	} while ((t = now() - start) < 0.5);
+
+	return t * 1e3 / n / (sz / (1024.0 * 1024.0));
+}
+
+int
+main(int argc, char *argv[])
+{
+	int		 c, check = 0, rc = 1;
+	char		**bufs, **vals = NULL;
+	size_t		 i, n, sz, valsz = 0, valmax = 0;
+	struct names	 names;
+
+	while (-1 != (c = getopt(argc, argv, "c")))
+		switch (c) {
+		case ('c'):
+			check = 1;
+			break;
+		default:
+			goto usage;
+		}
+
+	argc -= optind;
+	argv += optind;
+
+	if (0 == argc)
+		goto usage;
+
+	/* Time parsing, not the cache or index. */
+
+	unsetenv("DCMD_CACHE");
+	unsetenv("DCMD_INDEX");
+
+	memset(&names, 0, sizeof(struct names));
+	if (NULL == (bufs = calloc(argc, sizeof(char *))))
+		err(EXIT_FAILURE, NULL);
+	for (i = 0; i < (size_t)argc; i++) {
+		bufs[i] = file_read(argv[i], &sz);
+		if ( ! check) {
+			printf("%s: parse: %.2f ms/MB\n",
+				argv[i], bench_parse(argv[i], sz));
+			names_add(&names, argv[i], bufs[i], sz);
+		}
+		vals_add(bufs[i], &vals, &valsz, &valmax);
+	}
+
+	if (check) {
+		for (n = 0; NULL != edges[n]; n++)
+			rc = check_one(edges[n]) && rc;
+		for (i = 0; i < valsz; i++, n++)
+			rc = check_one(vals[i]) && rc;
+		printf("strtod check: %zu values: %s\n",
+			n, rc ? "ok" : "MISMATCH");
+	} else if (valsz > 0) {
+		printf("strtod: %zu values: %.1f ns/value\n",
+			valsz, bench_strtod(strtod, vals, valsz));
+		printf("divecmd_strtod: %zu values: %.1f ns/value\n",
+			valsz, bench_strtod(divecmd_strtod, vals, valsz));
+	}
+	if ( ! check && names.namesz > 0)
+		printf("divecmd_token: %zu names: %.1f ns/name\n",
+			names.namesz, bench_token(&names));
+
+	for (i = 0; i < (size_t)argc; i++)
+		free(bufs[i]);
+	free(bufs);
+	free(vals);
+	for (i = 0; i < names.namesz; i++)
+		free(names.names[i]);
+	free(names.names);
+	return(rc ? EXIT_SUCCESS : EXIT_FAILURE);
+usage:
+	fprintf(stderr, "usage: %s [-c] file ...\n", getprogname());
+	return(EXIT_FAILURE);
+}
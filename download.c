@@ -24,39 +24,119 @@
 #if HAVE_ERR
 # include <err.h>
 #endif
+#include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "extern.h"
 
+/*
+ * A dive copied out of dive_cb() for the output thread.
+ */
+struct	dljob {
+	unsigned char	 *data; /* raw dive */
+	unsigned int	  size; /* size of "data" */
+	char		 *fpbuf; /* fingerprint (hex) */
+	int		  last; /* stop after this dive */
+	size_t		  number; /* dive number, from 1 */
+	unsigned int	  devtime; /* device clock (no device) */
+	dc_ticks_t	  systime; /* host clock (no device) */
+	int		  ranged; /* already in range */
+};
+
+#define	DLQ_MAX	 32
+
+/*
+ * Dives passed from dive_cb(), which runs in the device transfer, to
+ * the output thread, which parses and prints them in order.
+ * It's bounded so that a fast device can't outrun output by much.
+ */
+struct	dlq {
+	pthread_mutex_t	  mtx; /* protects all */
+	pthread_cond_t	  cond; /* signalled on any change */
+	struct dljob	  jobs[DLQ_MAX]; /* ring of dives */
+	size_t		  first; /* first dive in ring */
+	size_t		  sz; /* dives in ring */
+	int		  done; /* no more dives will be added */
+	int		  stop; /* output wants no more dives */
+};
+
 typedef struct dive_data_t {
+	dc_context_t	 *context; /* library context */
 	dc_descriptor_t	 *descriptor; /* device */
-	dc_device_t	 *device; /* device */
+	dc_device_t	 *device; /* device (or NULL if stored) */
 	dc_buffer_t	**fingerprint; /* first fingerprint */
 	dc_buffer_t	 *ofp; /* only this fingerprint */
 	size_t	  	  number; /* dive number, from 1 */
 	enum dcmd_type 	  type; /* type of output */
 	struct dcmd_out	 *output; /* output handler */
 	const struct dcmd_rng *range; /* range to display */
+	struct dlq	  q; /* dives for output thread */
+	const char	 *rawdir; /* raw store or NULL */
+	dc_ticks_t	  session; /* start of download */
+	unsigned int	  devtime; /* device clock */
+	dc_ticks_t	  systime; /* host clock at devtime */
+	size_t		  skipped; /* dives out of range */
+	size_t		  skippedsz; /* bytes of "skipped" */
+	int		  early; /* stopped before range start */
+	unsigned int	  progress; /* transfer progress (bytes) */
+	unsigned int	  progressmax; /* transfer total (bytes) */
 } dive_data_t;
 
+static void
+dlq_lock(struct dlq *q)
+{
+
+	if ((errno = pthread_mutex_lock(&q->mtx)))
+		err(EXIT_FAILURE, "pthread_mutex_lock");
+}
+
+static void
+dlq_unlock(struct dlq *q)
+{
+
+	if ((errno = pthread_mutex_unlock(&q->mtx)))
+		err(EXIT_FAILURE, "pthread_mutex_unlock");
+}
+
+static void
+dlq_wait(struct dlq *q)
+{
+
+	if ((errno = pthread_cond_wait(&q->cond, &q->mtx)))
+		err(EXIT_FAILURE, "pthread_cond_wait");
+}
+
+static void
+dlq_signal(struct dlq *q)
+{
+
+	if ((errno = pthread_cond_signal(&q->cond)))
+		err(EXIT_FAILURE, "pthread_cond_signal");
+}
+
 /*
  * Check to see whether we fall within the range we care about.
  * If there is no range we care about, or if the dive doesn't support
  * extracting the time and date, return >0.
  * Else check that we fall (inclusively) within the range, returning
- * >0 we if do, 0 if we don't.
+ * >0 we if do, 0 if we don't, also setting "older" if the dive is
+ * before the range.
  * If errors occur, return <0.
  */
 static int
-check_range(dc_parser_t *parser, const struct dcmd_rng *rng)
+check_range(dc_parser_t *parser, const struct dcmd_rng *rng, int *older)
 {
 	int	 	 rc;
 	dc_ticks_t	 dtt;
 	dc_datetime_t	 dt;
 
+	*older = 0;
+
 	if (NULL == rng)
 		return(1);
 
@@ -81,34 +161,178 @@ check_range(dc_parser_t *parser, const struct dcmd_rng *rng)
 	
 	if (verbose)
 		fprintf(stderr, "Dive: no date range match\n");
+	*older = dtt < rng->start;
 	return(0);
 }
 
+/*
+ * Create a parser for the dive "data" of size "size".
+ * Stored dives have no device, so use the clock recorded when they
+ * were downloaded.
+ * Returns the parser or NULL on failure.
+ */
+static dc_parser_t *
+dive_parser(const dive_data_t *dd, const struct dljob *job,
+	const unsigned char *data, unsigned int size)
+{
+	dc_status_t	 rc;
+	dc_parser_t	*parser = NULL;
+
+	if (NULL != dd->device)
+		rc = dc_parser_new(&parser, dd->device);
+	else
+		rc = dc_parser_new2(&parser, dd->context, 
+			dd->descriptor, job->devtime, job->systime);
+	if (rc != DC_STATUS_SUCCESS)
+		return(NULL);
+
+	rc = dc_parser_set_data(parser, data, size);
+	if (rc != DC_STATUS_SUCCESS) {
+		dc_parser_destroy(parser);
+		return(NULL);
+	}
+
+	return(parser);
+}
+
+/*
+ * Parse and print a dive taken from the queue.
+ * Returns zero if we should stop processing dives, non-zero otherwise.
+ */
+static int
+dive_output(dive_data_t *dd, const struct dljob *job)
+{
+	dc_status_t	 rc = DC_STATUS_SUCCESS;
+	dc_parser_t	*parser = NULL;
+	int		 retc = 0, older;
+
+	if (NULL == (parser = dive_parser(dd, job, job->data, job->size)))
+		goto cleanup;
+
+	/* Check our date-time range, if not already done. */
+
+	if ( ! job->ranged) {
+		rc = check_range(parser, dd->range, &older);
+		if (0 == rc) {
+			retc = ! job->last;
+			goto cleanup;
+		} else if (rc < 0)
+			goto cleanup;
+	}
+
+	/* Parse the dive data. */
+
+	switch (dd->type) {
+	case (DC_OUTPUT_XML):
+		rc = output_xml_write(dd->output, 
+			job->number, parser, job->fpbuf);
+		break;
+	case (DC_OUTPUT_LIST):
+		rc = output_list_write
+			(dd->output, job->number, parser, job->fpbuf);
+		break;
+	}
+
+	/* Exit on error or fingerprint match. */
+
+	if (rc != DC_STATUS_SUCCESS || job->last)
+		goto cleanup;
+
+	retc = 1;
+cleanup:
+	dc_parser_destroy(parser);
+	return(retc);
+}
+
+/*
+ * The output thread.
+ * Dives are taken from the queue in the order that dive_cb() added
+ * them, so output is as if it were done in the callback.
+ * Once a dive says to stop, the rest are thrown away and dive_cb() is
+ * told to stop the transfer.
+ */
+static void *
+output_worker(void *arg)
+{
+	dive_data_t	*dd = arg;
+	struct dlq	*q = &dd->q;
+	struct dljob	 job;
+	int		 stop = 0;
+
+	for (;;) {
+		dlq_lock(q);
+		while (0 == q->sz && ! q->done)
+			dlq_wait(q);
+		if (0 == q->sz) {
+			dlq_unlock(q);
+			break;
+		}
+		job = q->jobs[q->first];
+		q->first = (q->first + 1) % DLQ_MAX;
+		q->sz--;
+		dlq_signal(q);
+		dlq_unlock(q);
+
+		if ( ! stop && ! dive_output(dd, &job)) {
+			stop = 1;
+			dlq_lock(q);
+			q->stop = 1;
+			dlq_signal(q);
+			dlq_unlock(q);
+		}
+		free(job.data);
+		free(job.fpbuf);
+	}
+
+	return(NULL);
+}
+
+/*
+ * Called by the device transfer for each dive.
+ * So as not to hold up the transfer, this only copies the dive for the
+ * output thread, waiting only if too many dives are queued.
+ */
 static int
 dive_cb(const unsigned char *data, unsigned int size, 
 	const unsigned char *fpr, unsigned int fprsz, 
 	void *userdata)
 {
 	dive_data_t	*dd = userdata;
-	dc_status_t	 rc = DC_STATUS_SUCCESS;
-	dc_parser_t	*parser = NULL;
+	struct dlq	*q = &dd->q;
 	dc_buffer_t	*fp;
+	dc_parser_t	*parser;
+	struct dljob	 job;
+	struct dcmd_raw	 raw;
 	unsigned int	 i;
-	char		*fpbuf = NULL;
-	int		 retc = 0;
+	int		 rc, older;
 
-	dd->number++;
+	memset(&job, 0, sizeof(struct dljob));
+	job.number = ++dd->number;
+	job.devtime = dd->devtime;
+	job.systime = dd->systime;
 
-	if (NULL == (fpbuf = malloc(fprsz * 2 + 1)))
+	if (NULL == (job.fpbuf = malloc(fprsz * 2 + 1)))
 		err(EXIT_FAILURE, NULL);
 
 	for (i = 0; i < fprsz; i++)
-		snprintf(&fpbuf[i * 2], 3, "%02X", fpr[i]);
+		snprintf(&job.fpbuf[i * 2], 3, "%02X", fpr[i]);
 
 	if (verbose)
 		fprintf(stderr, "Dive: number=%zu, "
 			"size=%u, fingerprint=%s\n", 
-			dd->number, size, fpbuf);
+			dd->number, size, job.fpbuf);
+
+	/* Keep every dive we see, if asked. */
+
+	if (NULL != dd->rawdir) {
+		memset(&raw, 0, sizeof(struct dcmd_raw));
+		raw.fpbuf = job.fpbuf;
+		raw.session = dd->session;
+		raw.index = dd->number;
+		raw.devtime = dd->devtime;
+		raw.systime = dd->systime;
+		raw_write(dd->rawdir, &raw, data, size);
+	}
 
 	/*
 	 * If we were asked only to print one dive, then stop processing
@@ -120,11 +344,12 @@ dive_cb(const unsigned char *data, unsigned int size,
 		    0 == memcmp(dc_buffer_get_data(dd->ofp), fpr, fprsz)) {
 			if (verbose)
 				fprintf(stderr, "Dive: fingerprint match\n");
+			job.last = 1;
 		} else {
 			if (verbose)
 				fprintf(stderr, "Dive: no fingerprint match\n");
-			retc = 1;
-			goto cleanup;
+			free(job.fpbuf);
+			return(1);
 		}
 	}
 
@@ -140,62 +365,73 @@ dive_cb(const unsigned char *data, unsigned int size,
 		*dd->fingerprint = fp;
 	}
 
-	/* Create the parser. */
-
-	rc = dc_parser_new(&parser, dd->device);
-	if (rc != DC_STATUS_SUCCESS)
-		goto cleanup;
-
-	/* Register the data. */
-
-	rc = dc_parser_set_data(parser, data, size);
-	if (rc != DC_STATUS_SUCCESS)
-		goto cleanup;
-
-	/* Check our date-time range, if applicable. */
-
-	if (0 == (rc = check_range(parser, dd->range))) {
-		retc = 1;
-		goto cleanup;
-	} else if (rc < 0)
-		goto cleanup;
-
-	/* Parse the dive data. */
+	/*
+	 * Check our date-time range here instead of in the output
+	 * thread.
+	 * Since dives are newest first, we can stop the transfer as soon
+	 * as one is older than the range.
+	 */
 
-	switch (dd->type) {
-	case (DC_OUTPUT_XML):
-		rc = output_xml_write(dd->output, 
-			dd->number, parser, fpbuf);
-		break;
-	case (DC_OUTPUT_LIST):
-		rc = output_list_write
-			(dd->output, dd->number, parser, fpbuf);
-		break;
+	if (NULL != dd->range) {
+		if (NULL == (parser = dive_parser(dd, &job, data, size))) {
+			free(job.fpbuf);
+			return(0);
+		}
+		rc = check_range(parser, dd->range, &older);
+		dc_parser_destroy(parser);
+		if (rc < 0) {
+			free(job.fpbuf);
+			return(0);
+		} else if (0 == rc) {
+			dd->skipped++;
+			dd->skippedsz += size;
+			free(job.fpbuf);
+			if ( ! older)
+				return(1);
+			if (verbose)
+				fprintf(stderr, "Dive: before date "
+					"range: stopping\n");
+			dd->early = 1;
+			return(0);
+		}
+		job.ranged = 1;
 	}
 
-	/* Exit on error or fingerprint match. */
+	/* The data is only valid during the callback. */
 
-	if (rc != DC_STATUS_SUCCESS ||
-	    (NULL != dd->ofp &&
-	     dc_buffer_get_size(dd->ofp) == fprsz &&
-	     0 == memcmp(dc_buffer_get_data(dd->ofp), fpr, fprsz)))
-		goto cleanup;
+	if (NULL == (job.data = malloc(size > 0 ? size : 1)))
+		err(EXIT_FAILURE, NULL);
+	memcpy(job.data, data, size);
+	job.size = size;
+
+	dlq_lock(q);
+	while (DLQ_MAX == q->sz && ! q->stop)
+		dlq_wait(q);
+	if (q->stop) {
+		dlq_unlock(q);
+		free(job.data);
+		free(job.fpbuf);
+		return(0);
+	}
+	q->jobs[(q->first + q->sz) % DLQ_MAX] = job;
+	q->sz++;
+	dlq_signal(q);
+	dlq_unlock(q);
 
-	retc = 1;
-cleanup:
-	dc_parser_destroy(parser);
-	free(fpbuf);
-	return(retc);
+	return( ! job.last);
 }
 
 /*
  * Print information about an event.
  * We only do this when we're running in high-verbosity mode.
+ * The clock is also recorded for the raw store, as some parsers need
+ * it to date the dives, and the progress for reporting on ranges.
  */
 static void
 event_cb(dc_device_t *device, dc_event_type_t event, 
 	const void *data, void *userdata)
 {
+	dive_data_t		  *dd = userdata;
 	const dc_event_progress_t *progress;
 	const dc_event_devinfo_t  *devinfo;
 	const dc_event_clock_t    *clock;
@@ -203,7 +439,16 @@ event_cb(dc_device_t *device, dc_event_type_t event,
 	unsigned int	 	   i;
 
 	(void)device;
-	(void)userdata;
+
+	if (DC_EVENT_CLOCK == event) {
+		clock = data;
+		dd->devtime = clock->devtime;
+		dd->systime = clock->systime;
+	} else if (DC_EVENT_PROGRESS == event) {
+		progress = data;
+		dd->progress = progress->current;
+		dd->progressmax = progress->maximum;
+	}
 
 	if (verbose < 2)
 		return;
@@ -244,21 +489,21 @@ event_cb(dc_device_t *device, dc_event_type_t event,
 	}
 }
 
+/*
+ * Open the device "devname" and register our fingerprint (unless
+ * looking for a single dive), event, and cancellation handlers.
+ * Returns the device in "devp" or NULL on failure.
+ */
 static dc_status_t
-parse(dc_context_t *context, dc_descriptor_t *descriptor, 
-	const char *devname, struct dcmd_out *output,
-	enum dcmd_type type, dc_buffer_t *fprint, 
-	dc_buffer_t *ofprint, dc_buffer_t **lfprint,
-	const struct dcmd_rng *rng)
+device_open(dc_context_t *context, dc_descriptor_t *descriptor, 
+	const char *devname, dc_buffer_t *fprint, 
+	dc_buffer_t *ofprint, dive_data_t *dd, dc_device_t **devp)
 {
 	dc_status_t	 rc = DC_STATUS_SUCCESS;
 	dc_device_t	*device = NULL;
 	int		 events;
-	dive_data_t	 dd;
 
-	memset(&dd, 0, sizeof(dive_data_t));
-
-	/* Open the device. */
+	*devp = NULL;
 
 	if (verbose)
 		fprintf(stderr, "%s: opening: %s, %s\n", devname,
@@ -268,7 +513,7 @@ parse(dc_context_t *context, dc_descriptor_t *descriptor,
 	rc = dc_device_open(&device, context, descriptor, devname);
 	if (rc != DC_STATUS_SUCCESS) {
 		warnx("%s: %s", devname, dctool_errmsg(rc));
-		goto cleanup;
+		return(rc);
 	}
 
 	if (NULL != fprint && NULL == ofprint) {
@@ -295,10 +540,11 @@ parse(dc_context_t *context, dc_descriptor_t *descriptor,
 	if (verbose)
 		fprintf(stderr, "%s: setting events\n", devname);
 	rc = dc_device_set_events
-		(device, events, event_cb, NULL);
+		(device, events, event_cb, dd);
 	if (rc != DC_STATUS_SUCCESS) {
 		warnx("%s: %s", devname, dctool_errmsg(rc));
-		goto cleanup;
+		dc_device_close(device);
+		return(rc);
 	}
 
 	/* Register the cancellation handler. */
@@ -307,11 +553,47 @@ parse(dc_context_t *context, dc_descriptor_t *descriptor,
 		(device, dctool_cancel_cb, NULL);
 	if (rc != DC_STATUS_SUCCESS) {
 		warnx("%s: %s", devname, dctool_errmsg(rc));
-		goto cleanup;
+		dc_device_close(device);
+		return(rc);
 	}
 
+	*devp = device;
+	return(rc);
+}
+
+static dc_status_t
+parse(dc_context_t *context, dc_descriptor_t *descriptor, 
+	const char *devname, struct dcmd_out *output,
+	enum dcmd_type type, dc_buffer_t *fprint, 
+	dc_buffer_t *ofprint, dc_buffer_t **lfprint,
+	const struct dcmd_rng *rng, const char *rawdir)
+{
+	dc_status_t	 rc = DC_STATUS_SUCCESS;
+	dc_device_t	*device = NULL;
+	dive_data_t	 dd;
+	pthread_t	 thr;
+
+	memset(&dd, 0, sizeof(dive_data_t));
+
+	/* 
+	 * Open the device.
+	 * A replayed device (see replay.c) has nothing to open: it's
+	 * given the fingerprint and handlers as it's played.
+	 */
+
+	if (replay_isdev(devname)) {
+		if (verbose)
+			fprintf(stderr, "%s: replaying: %s, %s\n", 
+				devname,
+				dc_descriptor_get_vendor(descriptor),
+				dc_descriptor_get_product(descriptor));
+	} else if (DC_STATUS_SUCCESS != (rc = device_open(context, 
+		   descriptor, devname, fprint, ofprint, &dd, &device)))
+		return(rc);
+
 	/* Initialize the dive data. */
 
+	dd.context = context;
 	dd.descriptor = descriptor;
 	dd.device = device;
 	dd.fingerprint = lfprint;
@@ -319,17 +601,54 @@ parse(dc_context_t *context, dc_descriptor_t *descriptor,
 	dd.type = type;
 	dd.ofp = ofprint;
 	dd.range = rng;
+	dd.rawdir = rawdir;
+	dd.session = time(NULL);
 
-	/* Download the dives. */
+	if ((errno = pthread_mutex_init(&dd.q.mtx, NULL)))
+		err(EXIT_FAILURE, "pthread_mutex_init");
+	if ((errno = pthread_cond_init(&dd.q.cond, NULL)))
+		err(EXIT_FAILURE, "pthread_cond_init");
+	if ((errno = pthread_create(&thr, NULL, output_worker, &dd)))
+		err(EXIT_FAILURE, "pthread_create");
 
-	rc = dc_device_foreach(device, dive_cb, &dd);
-	if (rc != DC_STATUS_SUCCESS) {
-		warnx("%s: %s", devname, dctool_errmsg(rc));
-		goto cleanup;
+	/* 
+	 * Download the dives.
+	 * When done, wait for the output thread to finish up.
+	 */
+
+	if (NULL != device)
+		rc = dc_device_foreach(device, dive_cb, &dd);
+	else
+		rc = replay_foreach(devname, NULL == ofprint ? 
+			fprint : NULL, event_cb, dive_cb, &dd);
+
+	dlq_lock(&dd.q);
+	dd.q.done = 1;
+	dlq_signal(&dd.q);
+	dlq_unlock(&dd.q);
+	if ((errno = pthread_join(thr, NULL)))
+		err(EXIT_FAILURE, "pthread_join");
+	pthread_cond_destroy(&dd.q.cond);
+	pthread_mutex_destroy(&dd.q.mtx);
+
+	if (NULL != rng && verbose) {
+		fprintf(stderr, "%s: %zu dives (%zu bytes) "
+			"outside of date range\n", devname, 
+			dd.skipped, dd.skippedsz);
+		if (dd.early && dd.progressmax > dd.progress)
+			fprintf(stderr, "%s: stopped early: %u of %u "
+				"bytes not transferred\n", devname, 
+				dd.progressmax - dd.progress, 
+				dd.progressmax);
+		else if (dd.early)
+			fprintf(stderr, "%s: stopped early\n", devname);
 	}
 
-cleanup:
-	dc_device_close(device);
+	if (rc != DC_STATUS_SUCCESS)
+		warnx("%s: %s", devname, dctool_errmsg(rc));
+
+	if (NULL != device)
+		dc_device_close(device);
 	return(rc);
 }
 
@@ -338,7 +657,7 @@ download(dc_context_t *context, dc_descriptor_t *descriptor,
 	const char *udev, enum dcmd_type type,
 	dc_buffer_t *fprint, dc_buffer_t *ofprint, 
 	dc_buffer_t **lfprint, const struct dcmd_rng *rng,
-	const char *ident)
+	const char *ident, const char *rawdir)
 {
 	int		 exitcode = 0;
 	dc_status_t	 status = DC_STATUS_SUCCESS;
@@ -359,7 +678,7 @@ download(dc_context_t *context, dc_descriptor_t *descriptor,
 
 	assert(NULL != output);
 	status = parse(context, descriptor, udev, 
-		output, type, fprint, ofprint, lfprint, rng);
+		output, type, fprint, ofprint, lfprint, rng, rawdir);
 
 	if (status != DC_STATUS_SUCCESS) {
 		warnx("%s", dctool_errmsg(status));
@@ -380,3 +699,311 @@ cleanup:
 
 	return(exitcode);
 }
+
+/*
+ * A stored dive being parsed and printed into its own buffer.
+ */
+struct	xjob {
+	char		*buf; /* printed dive */
+	size_t		 bufsz; /* length of "buf" */
+	int		 keep; /* from dive_output() */
+	int		 done; /* "buf" and "keep" are set */
+};
+
+/*
+ * Stored dives shared by the extract() workers.
+ * Workers take dives in order and print each into a buffer; the
+ * calling thread writes the buffers in that same order.
+ * Only XJOB_WIN dives per worker may be ahead of the writer, so memory
+ * stays bounded however many dives are stored.
+ */
+struct	xpool {
+	pthread_mutex_t	  mtx; /* protects all but "dd" and "raws" */
+	pthread_cond_t	  cond; /* signalled on any change */
+	const dive_data_t *dd; /* shared output parameters */
+	const struct dcmd_raw *raws; /* stored dives */
+	struct xjob	 *jobs; /* per stored dive */
+	size_t		  sz; /* number of dives */
+	size_t		  next; /* next dive to take */
+	size_t		  written; /* next dive to write */
+	size_t		  win; /* max dives ahead of written */
+	int		  stop; /* take no more dives */
+	int		  direct; /* sole worker: print to output */
+};
+
+#define	XJOB_WIN	 4
+#define	XJOB_POLL	 100000000L /* cancel check (ns) */
+
+static void *
+extract_worker(void *arg)
+{
+	struct xpool	*xp = arg;
+	dive_data_t	 dd;
+	struct dljob	 job;
+	FILE		*f;
+	char		*buf;
+	size_t		 i, bufsz;
+	int		 keep;
+
+	/* 
+	 * Each worker prints each dive into its own buffer, unless it's
+	 * the only worker, which prints directly to the output.
+	 */
+
+	dd = *xp->dd;
+
+	for (;;) {
+		if (xp->direct && dctool_cancel_cb(NULL)) {
+			warnx("%s", dctool_errmsg(DC_STATUS_CANCELLED));
+			break;
+		}
+
+		if ((errno = pthread_mutex_lock(&xp->mtx)))
+			err(EXIT_FAILURE, "pthread_mutex_lock");
+		while ( ! xp->direct && 
+		       ! xp->stop && xp->next < xp->sz &&
+		       xp->next >= xp->written + xp->win)
+			if ((errno = pthread_cond_wait
+			    (&xp->cond, &xp->mtx)))
+				err(EXIT_FAILURE, "pthread_cond_wait");
+		i = xp->stop || xp->next >= xp->sz ? xp->sz : xp->next++;
+		if ((errno = pthread_mutex_unlock(&xp->mtx)))
+			err(EXIT_FAILURE, "pthread_mutex_unlock");
+		if (i >= xp->sz)
+			break;
+
+		memset(&job, 0, sizeof(struct dljob));
+		job.number = i + 1;
+		job.fpbuf = xp->raws[i].fpbuf;
+		job.devtime = xp->raws[i].devtime;
+		job.systime = xp->raws[i].systime;
+		job.size = xp->raws[i].size;
+		job.last = i == xp->sz - 1 && NULL != xp->dd->ofp;
+
+		if (verbose)
+			fprintf(stderr, "Dive: number=%zu, "
+				"size=%u, fingerprint=%s\n", 
+				job.number, job.size, job.fpbuf);
+
+		buf = NULL;
+		bufsz = 0;
+
+		if (NULL == (job.data = raw_read(&xp->raws[i])))
+			keep = 1;
+		else if (xp->direct)
+			keep = dive_output(&dd, &job);
+		else {
+			if (NULL == (f = open_memstream(&buf, &bufsz)))
+				err(EXIT_FAILURE, "open_memstream");
+			dd.output = DC_OUTPUT_XML == dd.type ?
+				output_xml_new_stream(f) :
+				output_list_new_stream(f);
+			keep = dive_output(&dd, &job);
+			if (DC_OUTPUT_XML == dd.type)
+				output_xml_free(dd.output);
+			else
+				output_list_free(dd.output);
+			if (EOF == fclose(f))
+				err(EXIT_FAILURE, "open_memstream");
+		}
+		free(job.data);
+
+		if (xp->direct) {
+			xp->stop = ! keep;
+			continue;
+		}
+
+		if ((errno = pthread_mutex_lock(&xp->mtx)))
+			err(EXIT_FAILURE, "pthread_mutex_lock");
+		xp->jobs[i].buf = buf;
+		xp->jobs[i].bufsz = bufsz;
+		xp->jobs[i].keep = keep;
+		xp->jobs[i].done = 1;
+		if ((errno = pthread_cond_broadcast(&xp->cond)))
+			err(EXIT_FAILURE, "pthread_cond_broadcast");
+		if ((errno = pthread_mutex_unlock(&xp->mtx)))
+			err(EXIT_FAILURE, "pthread_mutex_unlock");
+	}
+
+	return(NULL);
+}
+
+/*
+ * Like download(), but with dives from the raw store "rawdir" instead
+ * of from a device.
+ * Dives are parsed and printed concurrently, one worker per CPU, but
+ * written newest first, as they would be from the device.
+ */
+int
+extract(dc_context_t *context, dc_descriptor_t *descriptor, 
+	const char *rawdir, enum dcmd_type type,
+	dc_buffer_t *ofprint, const struct dcmd_rng *rng,
+	const char *ident)
+{
+	dive_data_t	 dd;
+	struct xpool	 xp;
+	struct dcmd_raw	*raws;
+	struct xjob	*xj;
+	pthread_t	*thrs;
+	struct timespec	 ts;
+	char		*ofp = NULL;
+	long		 ncpu;
+	size_t		 i, rawsz, first = 0, last, nthrs;
+	int		 stop = 0;
+
+	if (NULL == (raws = raw_scan(rawdir, &rawsz)))
+		return(0);
+
+	if (verbose)
+		fprintf(stderr, "%s: %zu stored dives\n", rawdir, rawsz);
+
+	/* 
+	 * If we want only one fingerprint, look it up now and only
+	 * process that dive.
+	 * Fingerprints are stored as upper-case hex.
+	 */
+
+	if (NULL != ofprint) {
+		i = dc_buffer_get_size(ofprint);
+		if (NULL == (ofp = malloc(i * 2 + 1)))
+			err(EXIT_FAILURE, NULL);
+		ofp[0] = '\0';
+		for (i = 0; i < dc_buffer_get_size(ofprint); i++)
+			snprintf(&ofp[i * 2], 3, "%02X", 
+				dc_buffer_get_data(ofprint)[i]);
+		for (first = 0; first < rawsz; first++)
+			if (0 == strcasecmp(ofp, raws[first].fpbuf))
+				break;
+		if (verbose)
+			fprintf(stderr, "%s: %s\n", rawdir, first < rawsz ?
+				"fingerprint match" : "no fingerprint match");
+		last = first < rawsz ? first + 1 : rawsz;
+	} else
+		last = rawsz;
+
+	memset(&dd, 0, sizeof(dive_data_t));
+	dd.context = context;
+	dd.descriptor = descriptor;
+	dd.type = type;
+	dd.range = rng;
+	dd.ofp = ofprint;
+
+	switch (type) {
+	case (DC_OUTPUT_XML):
+		dd.output = output_xml_new(descriptor, ident);
+		break;
+	default:
+		dd.output = output_list_new();
+		break;
+	}
+
+	assert(NULL != dd.output);
+
+	/* Start the workers: no more than there are dives. */
+
+	memset(&xp, 0, sizeof(struct xpool));
+	xp.dd = &dd;
+	xp.raws = raws;
+	xp.sz = last;
+	xp.next = xp.written = first;
+	if (NULL == (xp.jobs = calloc(rawsz + 1, sizeof(struct xjob))))
+		err(EXIT_FAILURE, NULL);
+
+	ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	nthrs = ncpu < 1 ? 1 : (size_t)ncpu;
+	if (nthrs > last - first)
+		nthrs = last - first;
+	xp.win = nthrs * XJOB_WIN;
+
+	if ((errno = pthread_mutex_init(&xp.mtx, NULL)))
+		err(EXIT_FAILURE, "pthread_mutex_init");
+	if ((errno = pthread_cond_init(&xp.cond, NULL)))
+		err(EXIT_FAILURE, "pthread_cond_init");
+	if (NULL == (thrs = calloc(nthrs + 1, sizeof(pthread_t))))
+		err(EXIT_FAILURE, NULL);
+
+	/* 
+	 * With only one worker, there's no need for buffers: have it
+	 * print directly in the calling thread.
+	 */
+
+	if (nthrs < 2) {
+		xp.direct = 1;
+		if (nthrs)
+			extract_worker(&xp);
+		nthrs = 0;
+	}
+
+	for (i = 0; i < nthrs; i++)
+		if ((errno = pthread_create
+		    (&thrs[i], NULL, extract_worker, &xp)))
+			err(EXIT_FAILURE, "pthread_create");
+
+	/* 
+	 * Write dives in order as they're finished.
+	 * Stop as the device would: after a dive says so.
+	 */
+
+	for (i = first; nthrs > 0 && ! stop && i < last; i++) {
+		xj = &xp.jobs[i];
+		if ((errno = pthread_mutex_lock(&xp.mtx)))
+			err(EXIT_FAILURE, "pthread_mutex_lock");
+		while ( ! xj->done && ! dctool_cancel_cb(NULL)) {
+			/* Nothing signals us on SIGINT, so poll. */
+			if (-1 == clock_gettime(CLOCK_REALTIME, &ts))
+				err(EXIT_FAILURE, "clock_gettime");
+			if ((ts.tv_nsec += XJOB_POLL) >= 1000000000L) {
+				ts.tv_sec++;
+				ts.tv_nsec -= 1000000000L;
+			}
+			errno = pthread_cond_timedwait
+				(&xp.cond, &xp.mtx, &ts);
+			if (errno && ETIMEDOUT != errno)
+				err(EXIT_FAILURE, "pthread_cond_timedwait");
+		}
+		if ( ! xj->done) {
+			warnx("%s", dctool_errmsg(DC_STATUS_CANCELLED));
+			stop = 1;
+		} else if ( ! xj->keep)
+			stop = 1;
+		xp.stop = stop;
+		xp.written = i + 1;
+		if ((errno = pthread_cond_broadcast(&xp.cond)))
+			err(EXIT_FAILURE, "pthread_cond_broadcast");
+		if ((errno = pthread_mutex_unlock(&xp.mtx)))
+			err(EXIT_FAILURE, "pthread_mutex_unlock");
+
+		if (xj->done && xj->bufsz > 0 &&
+		    1 != fwrite(xj->buf, xj->bufsz, 1, stdout))
+			err(EXIT_FAILURE, "stdout");
+		free(xj->buf);
+		xj->buf = NULL;
+	}
+
+	for (i = 0; i < nthrs; i++)
+		if ((errno = pthread_join(thrs[i], NULL)))
+			err(EXIT_FAILURE, "pthread_join");
+
+	/* Anything printed after we stopped is thrown away. */
+
+	for (i = 0; i < last; i++)
+		free(xp.jobs[i].buf);
+
+	free(thrs);
+	free(xp.jobs);
+	pthread_cond_destroy(&xp.cond);
+	pthread_mutex_destroy(&xp.mtx);
+
+	switch (type) {
+	case (DC_OUTPUT_XML):
+		output_xml_free(dd.output);
+		break;
+	default:
+		output_list_free(dd.output);
+		break;
+	}
+
+	raw_free(raws, rawsz);
+	free(ofp);
+	return(1);
+}
@@ -39,6 +39,19 @@ struct	dcmd_rng {
 	dc_ticks_t	 end;
 };
 
+/*
+ * A dive kept in the raw store (see raw.c).
+ */
+struct	dcmd_raw {
+	char		*fpbuf; /* fingerprint (hex) */
+	char		*file; /* file in store (if scanned) */
+	dc_ticks_t	 session; /* when downloaded */
+	unsigned int	 index; /* dive number in session */
+	unsigned int	 devtime; /* device clock */
+	dc_ticks_t	 systime; /* host clock at devtime */
+	size_t		 size; /* size of dive (if scanned) */
+};
+
 __BEGIN_DECLS
 
 const char	*dctool_errmsg(dc_status_t);
@@ -46,18 +59,34 @@ const char	*dctool_errmsg(dc_status_t);
 int		 download(dc_context_t *, dc_descriptor_t *, 
 			const char *, enum dcmd_type, dc_buffer_t *, 
 			dc_buffer_t *, dc_buffer_t **,
+			const struct dcmd_rng *, const char *,
+			const char *);
+int		 extract(dc_context_t *, dc_descriptor_t *,
+			const char *, enum dcmd_type, dc_buffer_t *,
 			const struct dcmd_rng *, const char *);
 
 dc_status_t	 output_list_free(struct dcmd_out *);
 struct dcmd_out *output_list_new(void);
+struct dcmd_out *output_list_new_stream(FILE *);
 dc_status_t	 output_list_write(struct dcmd_out *, 
 			size_t, dc_parser_t *, const char *);
 
 dc_status_t	 output_xml_free(struct dcmd_out *);
 struct dcmd_out *output_xml_new(dc_descriptor_t *, const char *);
+struct dcmd_out *output_xml_new_stream(FILE *);
 dc_status_t	 output_xml_write(struct dcmd_out *, 
 			size_t, dc_parser_t *, const char *);
 
+void		 raw_free(struct dcmd_raw *, size_t);
+unsigned char	*raw_read(const struct dcmd_raw *);
+struct dcmd_raw	*raw_scan(const char *, size_t *);
+void		 raw_write(const char *, const struct dcmd_raw *,
+			const unsigned char *, unsigned int);
+
+int		 replay_isdev(const char *);
+dc_status_t	 replay_foreach(const char *, dc_buffer_t *,
+			dc_event_callback_t, dc_dive_callback_t, void *);
+
 int		 dctool_cancel_cb(void *userdata);
 
 extern int	 verbose;
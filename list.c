@@ -31,6 +31,7 @@
 
 struct	dcmd_list {
 	FILE		*ostream; /* output file */
+	int		 stream; /* caller's stream */
 };
 
 struct dcmd_out *
@@ -42,6 +43,24 @@ output_list_new(void)
 		err(EXIT_FAILURE, NULL);
 		
 	p->ostream = stdout;
+	p->stream = 0;
+	return((struct dcmd_out *)p);
+}
+
+/*
+ * Like output_list_new(), but writing into "f", which isn't closed by
+ * output_list_free().
+ */
+struct dcmd_out *
+output_list_new_stream(FILE *f)
+{
+	struct dcmd_list *p;
+
+	if (NULL == (p = malloc(sizeof(struct dcmd_list))))
+		err(EXIT_FAILURE, NULL);
+
+	p->ostream = f;
+	p->stream = 1;
 	return((struct dcmd_out *)p);
 }
 
@@ -99,7 +118,9 @@ output_list_free(struct dcmd_out *arg)
 {
 	struct dcmd_list *output = (struct dcmd_list *)arg;
 
-	if (NULL != output)
+	if (NULL != output && output->stream)
+		free(output);
+	else if (NULL != output)
 		fclose(output->ostream);
 
 	return(DC_STATUS_SUCCESS);
@@ -329,34 +329,14 @@ fprint_set(int fd, const char *file, dc_buffer_t *buf)
 }
 
 /*
- * Get the last-known fingerprint of "desc".
- * Sets "fd" and "filep" to be the file descriptor and filename of the
- * fingerprint file, or -1 and NULL.
- * If the file was empty (e.g., just created), the return is NULL, but
- * the file is open anyway.
+ * Make sure the directory "file" exists, creating it if it doesn't.
  */
-static dc_buffer_t *
-fprint_get(int *fd, char **filep, int all, 
-	dc_descriptor_t *desc, const char *ident)
+static void
+dir_make(const char *file)
 {
-	char		*cp, *ccp, *file;
-	unsigned char	 buf[1024];
-	dc_buffer_t	*res = NULL;
 	struct stat	 st;
-	size_t		 sz;
-	ssize_t		 ssz;
 	int		 rc;
 
-	*fd = -1;
-	*filep = NULL;
-
-	/*
-	 * First, make sure our directory exists.
-	 * If it doesn't, create it.
-	 */
-
-	if (asprintf(&file, "%s/.divecmd", getenv("HOME")) < 0)
-		err(EXIT_FAILURE, NULL);
 	if (-1 == (rc = stat(file, &st)) && ENOENT != errno)
 		err(EXIT_FAILURE, "%s", file);
 
@@ -367,10 +347,16 @@ fprint_get(int *fd, char **filep, int all,
 			err(EXIT_FAILURE, "%s", file);
 	} else if ( ! (S_IFDIR & st.st_mode)) 
 		errx(EXIT_FAILURE, "%s: not a directory", file);
+}
 
-	free(file);
-
-	/* Escape device name as file. */
+/*
+ * Render the device "desc" and diver "ident" as a filename.
+ */
+static char *
+dev_name(dc_descriptor_t *desc, const char *ident)
+{
+	char	*cp, *ccp;
+	int	 rc;
 
 	rc = NULL == ident ?
 		asprintf(&cp, "%s %s-%u", 
@@ -394,6 +380,75 @@ fprint_get(int *fd, char **filep, int all,
 		else if (isalpha((int)*ccp))
 			*ccp = tolower((int)*ccp);
 
+	return(cp);
+}
+
+/*
+ * Get the raw store of "desc", ~/.divecmd/raw/DEVICE.
+ * If "create" is set, make sure it (and its parents) exist.
+ */
+static char *
+rawdir_get(dc_descriptor_t *desc, const char *ident, int create)
+{
+	char	*cp, *file;
+
+	cp = dev_name(desc, ident);
+
+	if (create) {
+		if (asprintf(&file, "%s/.divecmd", getenv("HOME")) < 0)
+			err(EXIT_FAILURE, NULL);
+		dir_make(file);
+		free(file);
+		if (asprintf(&file, "%s/.divecmd/raw", getenv("HOME")) < 0)
+			err(EXIT_FAILURE, NULL);
+		dir_make(file);
+		free(file);
+	}
+
+	if (asprintf(&file, "%s/.divecmd/raw/%s", getenv("HOME"), cp) < 0)
+		err(EXIT_FAILURE, NULL);
+	if (create)
+		dir_make(file);
+
+	free(cp);
+	return(file);
+}
+
+/*
+ * Get the last-known fingerprint of "desc".
+ * Sets "fd" and "filep" to be the file descriptor and filename of the
+ * fingerprint file, or -1 and NULL.
+ * If the file was empty (e.g., just created), the return is NULL, but
+ * the file is open anyway.
+ */
+static dc_buffer_t *
+fprint_get(int *fd, char **filep, int all, 
+	dc_descriptor_t *desc, const char *ident)
+{
+	char		*cp, *file;
+	unsigned char	 buf[1024];
+	dc_buffer_t	*res = NULL;
+	struct stat	 st;
+	size_t		 sz;
+	ssize_t		 ssz;
+
+	*fd = -1;
+	*filep = NULL;
+
+	/*
+	 * First, make sure our directory exists.
+	 * If it doesn't, create it.
+	 */
+
+	if (asprintf(&file, "%s/.divecmd", getenv("HOME")) < 0)
+		err(EXIT_FAILURE, NULL);
+	dir_make(file);
+	free(file);
+
+	/* Escape device name as file. */
+
+	cp = dev_name(desc, ident);
+
 	/* Open ~/.divecmd/DEVICE, exiting on new file or fail. */
 
 	if (asprintf(&file, "%s/.divecmd/%s", getenv("HOME"), cp) < 0)
@@ -581,12 +636,12 @@ main(int argc, char *argv[])
 	int 		 show = 0, ch, ofd = -1, nofp = 0, all = 0;
 	dc_buffer_t	*fprint = NULL, *ofprint = NULL, *lprint = NULL;
 	enum dcmd_type	 out = DC_OUTPUT_XML;
-	char		*ofile = NULL;
+	char		*ofile = NULL, *rawdir = NULL;
 	struct dcmd_rng	*rng = NULL;
 	unsigned int	 model = 0;
-	int		 has_model = 0;
+	int		 has_model = 0, keep = 0, stored = 0;
 
-	while (-1 != (ch = getopt (argc, argv, "ad:f:i:lm:nr:sv"))) {
+	while (-1 != (ch = getopt (argc, argv, "ad:f:i:klm:nr:svx"))) {
 		switch (ch) {
 		case 'a':
 			all = 1;
@@ -600,6 +655,9 @@ main(int argc, char *argv[])
 		case 'i':
 			ident = optarg;
 			break;
+		case 'k':
+			keep = 1;
+			break;
 		case 'l':
 			out = DC_OUTPUT_LIST;
 			break;
@@ -625,6 +683,9 @@ main(int argc, char *argv[])
 				loglevel++;
 			verbose++;
 			break;
+		case 'x':
+			stored = 1;
+			break;
 		default:
 			goto usage;
 		}
@@ -668,9 +729,20 @@ main(int argc, char *argv[])
 	if (NULL != range && parserange(range, &rng))
 		all = nofp = 1;
 
+	/* 
+	 * Dives from the raw store don't touch the last-seen
+	 * fingerprint: we aren't downloading anything.
+	 */
+
+	if (stored)
+		rawdir = rawdir_get(descriptor, ident, 0);
+	else if (keep)
+		rawdir = rawdir_get(descriptor, ident, 1);
+
 	/* Deserialise last-seen fingerprint. */
 
-	fprint = fprint_get(&ofd, &ofile, all, descriptor, ident);
+	if ( ! stored)
+		fprint = fprint_get(&ofd, &ofile, all, descriptor, ident);
 
 	/* Setup the cancel signal handler. */
 
@@ -694,11 +766,16 @@ main(int argc, char *argv[])
 	 * Do the full download and parse, setting the last fingerprint
 	 * if it's found, given our range constraints, last-seen
 	 * fingerprint constraint, and single-fingerprint constraint.
+	 * Or re-parse stored dives instead of downloading.
 	 */
 
-	exitcode = download
-		(context, descriptor, udev, 
-		 out, fprint, ofprint, &lprint, rng, ident);
+	if (stored)
+		exitcode = extract(context, descriptor, 
+			rawdir, out, ofprint, rng, ident);
+	else
+		exitcode = download(context, descriptor, udev, 
+			out, fprint, ofprint, &lprint, rng, ident, 
+			rawdir);
 
 	/* Serialise last fingerprint if found & enabled. */
 
@@ -718,10 +795,11 @@ cleanup:
 	dc_buffer_free(fprint);
 	dc_buffer_free(ofprint);
 	free(ofile);
+	free(rawdir);
 	free(rng);
 	return(exitcode ? EXIT_SUCCESS : EXIT_FAILURE);
 usage:
-	fprintf(stderr, "usage: %s [-anv] [-d device] "
+	fprintf(stderr, "usage: %s [-aknvx] [-d device] "
 				  "[-f fingerprint] "
 				  "[-i identity] "
 				  "[-m model] computer\n"
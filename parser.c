@@ -16,7 +16,9 @@
  */
 #include "config.h"
 
+#include <sys/mman.h>
 #include <sys/queue.h>
+#include <sys/stat.h>
 
 #include <assert.h>
 #if HAVE_ERR
@@ -26,7 +28,9 @@
 #include <float.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <pthread.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -37,6 +41,18 @@
 
 #include "parser.h"
 
+#define	NUMSET_MAX	 1024
+
+/*
+ * Gas or cylinder numbers of a dive, for checking references to them
+ * without scanning the dive's array.
+ * Only numbers less than NUMSET_MAX are held: see gas_exists() and
+ * cyl_exists() for the rest.
+ */
+struct	numset {
+	unsigned char	 bits[NUMSET_MAX / 8];
+};
+
 struct	parse {
 	XML_Parser	  p; /* parser routine */
 	const char	 *file; /* parsed filename */
@@ -45,9 +61,442 @@ struct	parse {
 	struct samp	 *cursamp; /* current sample */
 	struct diveq	 *dives; /* all dives */
 	struct divestat	 *stat; /* statistics */
-	char		 *buf; /* temporary buffer */
+	char		 *buf; /* element text (see buf_grow()) */
 	size_t		  bufsz; /* length of buf */
+	size_t		  bufmax; /* bytes allocated to buf */
 	size_t		  pid;
+	struct dgroup	 *loggroup; /* divelog group of curlog */
+	int		  quiet; /* don't report new groups */
+	int		(*cb)(struct dive *, void *); /* dive callback */
+	void		 *arg; /* callback argument */
+	int		  stopped; /* callback stopped parse */
+	size_t		  linkerrs; /* dives failing link_dive() */
+	size_t		  warns; /* warnings issued */
+	int		  caching; /* keep dates for cache_write() */
+	char		**dates; /* <dive> dates (or NULL) by pid */
+	size_t		  datesz; /* slots in "dates" */
+	int		  indexing; /* keep dates, ranges for idx_write() */
+	int		  noidx; /* dives can't be indexed */
+	struct irange	 *ranges; /* <dive> byte ranges by pid */
+	size_t		  rangesz; /* slots in "ranges" */
+	size_t		  depth; /* element nesting */
+	enum token	  d2tok; /* last element at depth two */
+	struct ifeed	 *feed; /* partial parse (or NULL) */
+	struct samp	  scratch; /* sample in summary, compact parses */
+	unsigned char	  nibble; /* pending <vendor> digit plus one */
+	int		  vendorbad; /* <vendor> text isn't hex */
+	struct csamp	 *stage; /* compact parse: current dive's columns */
+	size_t		  stagesz; /* samples in "stage" */
+	size_t		  stagemax; /* slots in "stage" */
+	struct dtcache	  dates_tz; /* <dive> date conversion */
+	struct numset	  gasnums; /* current dive's <gasmix> nums */
+};
+
+/*
+ * Bytes spanned by an element in the input.
+ */
+struct	irange {
+	uint64_t	 off;
+	uint64_t	 len;
+};
+
+/*
+ * A sample's columns, staged until its dive closes in a compact parse.
+ */
+struct	csamp {
+	size_t		 time;
+	double		 depth;
+	double		 temp;
+	double		 cns;
+	unsigned char	 flags;
+};
+
+/*
+ * Sample fields kept out of line in compact parses.
+ * (Samples with pressures or events are also kept out of line.)
+ */
+#define	SAMP_RARE	(SAMP_RBT | SAMP_DECO | SAMP_VENDOR | SAMP_GASCHANGE)
+
+/*
+ * A partial parse from a sidecar index.
+ * We feed the bytes before the first dive, those of the chosen dives,
+ * then those after the last; dives not chosen are filled in from the
+ * index alone.
+ * Parse positions within dives are mapped back onto the file.
+ */
+struct	ifeed {
+	char		*map; /* mapped index */
+	size_t		 mapsz; /* size of "map" */
+	uint64_t	 head; /* bytes before first dive */
+	uint64_t	 tail; /* offset after last dive */
+	uint64_t	 size; /* size of file */
+	const struct idxdive *dives; /* dives in index */
+	size_t		 divesz; /* number of "dives" */
+	const char	*strs; /* string table */
+	uint64_t	 strsz; /* bytes in "strs" */
+	unsigned char	*chosen; /* whether to parse each dive */
+	size_t		 next; /* next dive in index */
+	size_t		 line; /* parse line of current dive */
+	size_t		 col; /* parse column of current dive */
+};
+
+/*
+ * Dive memory is carved out of chunks that start small and double in
+ * size (up to a limit) as more samples are read.
+ * The most recently-allocated chunk is at the head of the list.
+ */
+struct	dchunk {
+	struct dchunk	*next; /* next (older) chunk */
+	size_t		 size; /* usable size of buf */
+	size_t		 used; /* bytes handed out */
+	size_t		 last; /* offset of last allocation */
+	unsigned char	 buf[]; /* memory */
+};
+
+/*
+ * A file being parsed by divecmd_parse() or divecmd_parse_many().
+ * Its dives, groups, and divelogs are later merged into the caller's.
+ */
+struct	pfile {
+	const char	 *fname; /* file or "-" */
+	struct diveq	  dives; /* dives in parse order */
+	struct divestat	  stat; /* file's groups, divelogs, etc. */
+	int		  rc; /* parse_pfile() return value */
+	int		(*sel)(const struct dindex *, void *); /* or NULL */
+	void		 *arg; /* "sel" argument */
+};
+
+/*
+ * Files shared by divecmd_parse_many() workers.
+ */
+struct	pmany {
+	pthread_mutex_t	  mtx; /* protects "next" */
+	size_t		  next; /* next file to parse */
+	struct pfile	 *files; /* files to parse */
+	size_t		  filesz; /* number of files */
+};
+
+/*
+ * Used when ordering dives: see dives_sort().
+ */
+struct	dsort {
+	struct dive	*d;
+	int		 dated; /* has a date and time */
+	time_t		 key; /* sort key (if dated) */
+	double		 gkey; /* see group_key() */
+	size_t		 seq; /* position in queue */
+};
+
+/*
+ * Sections of a cache file, in file order.
+ * All but the string table hold fixed-size records whose sizes are
+ * multiples of eight, so every section is aligned.
+ */
+enum	csect {
+	CSECT_LOGS, /* struct cachelog */
+	CSECT_DIVES, /* struct cachedive */
+	CSECT_GAS, /* struct cachegas */
+	CSECT_CYLS, /* struct cachecyl */
+	CSECT_TIME, /* sample time column (uint64_t) */
+	CSECT_DEPTH, /* sample depth column (double) */
+	CSECT_TEMP, /* sample temperature column (double) */
+	CSECT_CNS, /* sample CNS column (double) */
+	CSECT_SAMPS, /* struct cachesamp (rest of sample) */
+	CSECT_PRES, /* struct cachepres */
+	CSECT_EVENTS, /* struct cacheevent */
+	CSECT_STRS, /* nil-terminated strings */
+	CSECT__MAX
+};
+
+/*
+ * Start of a cache file.
+ * Strings in the records below are references into the string table:
+ * zero for NULL, else one plus the offset.
+ * Dives, and the samples within each dive, are in parse order, with
+ * each dive's gasses, cylinders, and samples contiguous.
+ * Sample pressures and events follow in sample order.
+ */
+struct	cachehdr {
+	char		 magic[8]; /* CACHE_MAGIC */
+	uint32_t	 version; /* CACHE_VERSION */
+	uint32_t	 endian; /* CACHE_ENDIAN in host order */
+	uint64_t	 dev; /* source device */
+	uint64_t	 ino; /* source inode */
+	uint64_t	 size; /* source size */
+	int64_t		 mtime; /* source modification (seconds) */
+	int64_t		 mtimens; /* source modification (nanoseconds) */
+	uint64_t	 ndlogs;
+	uint64_t	 ndives;
+	uint64_t	 ngas;
+	uint64_t	 ncyls;
+	uint64_t	 nsamps;
+	uint64_t	 npres;
+	uint64_t	 nevents;
+	uint64_t	 strsz; /* bytes in string table */
+	uint32_t	 want; /* fields parsed (see divecmd_init()) */
+	uint32_t	 pad;
+};
+
+struct	cachelog {
+	uint64_t	 line;
+	uint32_t	 ident;
+	uint32_t	 program;
+	uint32_t	 vendor;
+	uint32_t	 product;
+	uint32_t	 model;
+	uint32_t	 pad;
+};
+
+struct	cachedive {
+	int64_t		 datetime;
+	uint64_t	 pid;
+	uint64_t	 num;
+	uint64_t	 duration;
+	uint64_t	 maxtime;
+	uint64_t	 line;
+	uint64_t	 col;
+	double		 maxdepth;
+	double		 maxtemp;
+	double		 mintemp;
+	uint64_t	 gas; /* index of first gas */
+	uint64_t	 cyls; /* index of first cylinder */
+	uint64_t	 samps; /* index of first sample */
+	uint64_t	 nsamps;
+	uint32_t	 gassz;
+	uint32_t	 cylsz;
+	uint32_t	 mode;
+	uint32_t	 hastemp;
+	uint32_t	 log; /* index of divelog */
+	uint32_t	 fprint; /* fingerprint string */
+	uint32_t	 date; /* <dive> date string */
+	uint32_t	 pad;
+};
+
+struct	cachegas {
+	double		 o2;
+	double		 n2;
+	double		 he;
+	uint64_t	 num;
+};
+
+struct	cachecyl {
+	uint64_t	 num;
+	uint64_t	 mix;
+	double		 size;
+	double		 workpressure;
+};
+
+struct	cachesamp {
+	uint64_t	 rbt;
+	uint64_t	 gaschange;
+	uint64_t	 line;
+	uint64_t	 col;
+	uint64_t	 decoduration;
+	uint64_t	 vendortype;
+	double		 decodepth;
+	uint32_t	 flags;
+	uint32_t	 decotype;
+	uint32_t	 vendor; /* vendor data */
+	uint32_t	 vendorsz; /* bytes of vendor data */
+	uint32_t	 pressuresz;
+	uint32_t	 eventsz;
+};
+
+struct	cachepres {
+	uint64_t	 tank;
+	double		 pressure;
+};
+
+struct	cacheevent {
+	uint64_t	 duration;
+	uint32_t	 flags;
+	uint32_t	 type;
+};
+
+/*
+ * Start of a sidecar index, followed by its dives (in parse order, so
+ * that the parse identifier is one plus the position) then a string
+ * table as in the cache.
+ */
+struct	idxhdr {
+	char		 magic[8]; /* IDX_MAGIC */
+	uint32_t	 version; /* IDX_VERSION */
+	uint32_t	 endian; /* CACHE_ENDIAN in host order */
+	uint64_t	 dev; /* source device */
+	uint64_t	 ino; /* source inode */
+	uint64_t	 size; /* source size */
+	int64_t		 mtime; /* source modification (seconds) */
+	int64_t		 mtimens; /* source modification (nanoseconds) */
+	uint64_t	 head; /* bytes before first dive */
+	uint64_t	 tail; /* offset after last dive */
+	uint64_t	 ndives;
+	uint64_t	 strsz; /* bytes in string table */
+};
+
+struct	idxdive {
+	uint64_t	 off; /* offset of <dive> */
+	uint64_t	 len; /* bytes through </dive> */
+	int64_t		 datetime;
+	uint64_t	 num;
+	uint64_t	 duration;
+	uint64_t	 line;
+	uint64_t	 col;
+	double		 maxdepth;
+	uint32_t	 mode;
+	uint32_t	 fprint; /* fingerprint string */
+	uint32_t	 date; /* <dive> date string */
+	uint32_t	 pad;
+};
+
+#define	CACHE_MAGIC	 "dcmdcach"
+#define	CACHE_VERSION	 3
+#define	CACHE_ENDIAN	 0x01020304
+#define	CACHE_POSITIONS	 0x80000000U /* in "want": sample positions kept */
+
+#define	IDX_MAGIC	 "dcmdindx"
+#define	IDX_VERSION	 1
+
+#define	GROUPHASH_BASIS	 2166136261U
+#define	GROUPHASH_PRIME	 16777619U
+
+#define	FPHASH_BASIS	 14695981039346656037ULL
+#define	FPHASH_PRIME	 1099511628211ULL
+
+#define	FEED_CHUNK	 (1024 * 1024)
+#define	FEED_READSZ	 (64 * 1024)
+
+#define	DCHUNK_MIN	 1024
+#define	DCHUNK_MAX	 (1024 * 1024)
+#define	DCHUNK_ALIGN	 16
+#define	MUL_NO_OVERFLOW	 ((size_t)1 << (sizeof(size_t) * 4))
+
+/*
+ * Perfect hash of a name's length and its first, second, and last
+ * characters into "tokmap".
+ * Each name in "tokens" must hash into a distinct slot: if a name is
+ * added, make sure that it doesn't collide (-Woverride-init) or adjust
+ * the multipliers until nothing does.
+ */
+#define	TOKEN_HASH(_len, _c0, _c1, _cn) \
+	(((_len) + 8 * (_c0) + 6 * (_c1) + (_cn)) & 0xff)
+
+static	const char *tokens[TOKEN__MAX] = {
+	NULL, /* TOKEN__NONE */
+	"cns", /* TOKEN_cns */
+	"cylinder", /* TOKEN_cylinder */
+	"date", /* TOKEN_date */
+	"dctype", /* TOKEN_dctype */
+	"deco", /* TOKEN_deco */
+	"depth", /* TOKEN_depth */
+	"description", /* TOKEN_description */
+	"dive", /* TOKEN_dive */
+	"divecomputer", /* TOKEN_divecomputer */
+	"divecomputerid", /* TOKEN_divecomputerid */
+	"diveid", /* TOKEN_diveid */
+	"divelog", /* TOKEN_divelog */
+	"diver", /* TOKEN_diver */
+	"dives", /* TOKEN_dives */
+	"divesites", /* TOKEN_divesites */
+	"duration", /* TOKEN_duration */
+	"event", /* TOKEN_event */
+	"extradata", /* TOKEN_extradata */
+	"fingerprint", /* TOKEN_fingerprint */
+	"flags", /* TOKEN_flags */
+	"gaschange", /* TOKEN_gaschange */
+	"gasmix", /* TOKEN_gasmix */
+	"gasmixes", /* TOKEN_gasmixes */
+	"he", /* TOKEN_he */
+	"in_deco", /* TOKEN_in_deco */
+	"mix", /* TOKEN_mix */
+	"mode", /* TOKEN_mode */
+	"model", /* TOKEN_model */
+	"n2", /* TOKEN_n2 */
+	"ndl", /* TOKEN_ndl */
+	"num", /* TOKEN_num */
+	"number", /* TOKEN_number */
+	"o2", /* TOKEN_o2 */
+	"pressure", /* TOKEN_pressure */
+	"product", /* TOKEN_product */
+	"program", /* TOKEN_program */
+	"rbt", /* TOKEN_rbt */
+	"sample", /* TOKEN_sample */
+	"samples", /* TOKEN_samples */
+	"settings", /* TOKEN_settings */
+	"size", /* TOKEN_size */
+	"stopdepth", /* TOKEN_stopdepth */
+	"stoptime", /* TOKEN_stoptime */
+	"surface", /* TOKEN_surface */
+	"tank", /* TOKEN_tank */
+	"tanks", /* TOKEN_tanks */
+	"temp", /* TOKEN_temp */
+	"temperature", /* TOKEN_temperature */
+	"time", /* TOKEN_time */
+	"type", /* TOKEN_type */
+	"value", /* TOKEN_value */
+	"vendor", /* TOKEN_vendor */
+	"version", /* TOKEN_version */
+	"volume", /* TOKEN_volume */
+	"water", /* TOKEN_water */
+	"workpressure", /* TOKEN_workpressure */
+};
+
+static	const unsigned char tokmap[256] = {
+	[TOKEN_HASH(3, 'c', 'n', 's')] = TOKEN_cns,
+	[TOKEN_HASH(8, 'c', 'y', 'r')] = TOKEN_cylinder,
+	[TOKEN_HASH(4, 'd', 'a', 'e')] = TOKEN_date,
+	[TOKEN_HASH(6, 'd', 'c', 'e')] = TOKEN_dctype,
+	[TOKEN_HASH(4, 'd', 'e', 'o')] = TOKEN_deco,
+	[TOKEN_HASH(5, 'd', 'e', 'h')] = TOKEN_depth,
+	[TOKEN_HASH(11, 'd', 'e', 'n')] = TOKEN_description,
+	[TOKEN_HASH(4, 'd', 'i', 'e')] = TOKEN_dive,
+	[TOKEN_HASH(12, 'd', 'i', 'r')] = TOKEN_divecomputer,
+	[TOKEN_HASH(14, 'd', 'i', 'd')] = TOKEN_divecomputerid,
+	[TOKEN_HASH(6, 'd', 'i', 'd')] = TOKEN_diveid,
+	[TOKEN_HASH(7, 'd', 'i', 'g')] = TOKEN_divelog,
+	[TOKEN_HASH(5, 'd', 'i', 'r')] = TOKEN_diver,
+	[TOKEN_HASH(5, 'd', 'i', 's')] = TOKEN_dives,
+	[TOKEN_HASH(9, 'd', 'i', 's')] = TOKEN_divesites,
+	[TOKEN_HASH(8, 'd', 'u', 'n')] = TOKEN_duration,
+	[TOKEN_HASH(5, 'e', 'v', 't')] = TOKEN_event,
+	[TOKEN_HASH(9, 'e', 'x', 'a')] = TOKEN_extradata,
+	[TOKEN_HASH(11, 'f', 'i', 't')] = TOKEN_fingerprint,
+	[TOKEN_HASH(5, 'f', 'l', 's')] = TOKEN_flags,
+	[TOKEN_HASH(9, 'g', 'a', 'e')] = TOKEN_gaschange,
+	[TOKEN_HASH(6, 'g', 'a', 'x')] = TOKEN_gasmix,
+	[TOKEN_HASH(8, 'g', 'a', 's')] = TOKEN_gasmixes,
+	[TOKEN_HASH(2, 'h', 'e', 'e')] = TOKEN_he,
+	[TOKEN_HASH(7, 'i', 'n', 'o')] = TOKEN_in_deco,
+	[TOKEN_HASH(3, 'm', 'i', 'x')] = TOKEN_mix,
+	[TOKEN_HASH(4, 'm', 'o', 'e')] = TOKEN_mode,
+	[TOKEN_HASH(5, 'm', 'o', 'l')] = TOKEN_model,
+	[TOKEN_HASH(2, 'n', '2', '2')] = TOKEN_n2,
+	[TOKEN_HASH(3, 'n', 'd', 'l')] = TOKEN_ndl,
+	[TOKEN_HASH(3, 'n', 'u', 'm')] = TOKEN_num,
+	[TOKEN_HASH(6, 'n', 'u', 'r')] = TOKEN_number,
+	[TOKEN_HASH(2, 'o', '2', '2')] = TOKEN_o2,
+	[TOKEN_HASH(8, 'p', 'r', 'e')] = TOKEN_pressure,
+	[TOKEN_HASH(7, 'p', 'r', 't')] = TOKEN_product,
+	[TOKEN_HASH(7, 'p', 'r', 'm')] = TOKEN_program,
+	[TOKEN_HASH(3, 'r', 'b', 't')] = TOKEN_rbt,
+	[TOKEN_HASH(6, 's', 'a', 'e')] = TOKEN_sample,
+	[TOKEN_HASH(7, 's', 'a', 's')] = TOKEN_samples,
+	[TOKEN_HASH(8, 's', 'e', 's')] = TOKEN_settings,
+	[TOKEN_HASH(4, 's', 'i', 'e')] = TOKEN_size,
+	[TOKEN_HASH(9, 's', 't', 'h')] = TOKEN_stopdepth,
+	[TOKEN_HASH(8, 's', 't', 'e')] = TOKEN_stoptime,
+	[TOKEN_HASH(7, 's', 'u', 'e')] = TOKEN_surface,
+	[TOKEN_HASH(4, 't', 'a', 'k')] = TOKEN_tank,
+	[TOKEN_HASH(5, 't', 'a', 's')] = TOKEN_tanks,
+	[TOKEN_HASH(4, 't', 'e', 'p')] = TOKEN_temp,
+	[TOKEN_HASH(11, 't', 'e', 'e')] = TOKEN_temperature,
+	[TOKEN_HASH(4, 't', 'i', 'e')] = TOKEN_time,
+	[TOKEN_HASH(4, 't', 'y', 'e')] = TOKEN_type,
+	[TOKEN_HASH(5, 'v', 'a', 'e')] = TOKEN_value,
+	[TOKEN_HASH(6, 'v', 'e', 'r')] = TOKEN_vendor,
+	[TOKEN_HASH(7, 'v', 'e', 'n')] = TOKEN_version,
+	[TOKEN_HASH(6, 'v', 'o', 'e')] = TOKEN_volume,
+	[TOKEN_HASH(5, 'w', 'a', 'r')] = TOKEN_water,
+	[TOKEN_HASH(12, 'w', 'o', 'e')] = TOKEN_workpressure,
 };
 
 static	const char *decos[DECO__MAX] = {
@@ -91,7 +540,7 @@ logdbg(const struct parse *p, const char *fmt, ...)
 	__attribute__((format (printf, 2, 3)));
 
 static void
-logwarnx(const struct parse *p, const char *fmt, ...)
+logwarnx(struct parse *p, const char *fmt, ...)
 	__attribute__((format (printf, 2, 3)));
 
 static void
@@ -102,23 +551,62 @@ static __dead void
 logfatal(const struct parse *p, const char *fmt, ...)
 	__attribute__((format (printf, 2, 3)));
 
+/*
+ * The parser's position in the file.
+ * In a partial parse, positions within a dive are offset by where the
+ * dive was in the parse and where it is in the file.
+ */
+static void
+parse_pos(const struct parse *p, size_t *line, size_t *col)
+{
+
+	*line = XML_GetCurrentLineNumber(p->p);
+	*col = XML_GetCurrentColumnNumber(p->p);
+	if (NULL == p->feed || NULL == p->curdive)
+		return;
+	if (*line == p->feed->line)
+		*col = *col - p->feed->col + p->curdive->col;
+	*line = *line - p->feed->line + p->curdive->line;
+}
+
+/*
+ * Start a message with our position: the parser's, or if there's no
+ * parser (e.g., when loading from a cache), the current dive's.
+ */
+static void
+logpos(const struct parse *p, const char *type)
+{
+	size_t	 line, col;
+
+	if (NULL != p->p) {
+		parse_pos(p, &line, &col);
+		fprintf(stderr, "%s:%zu:%zu: %s", 
+			p->file, line, col, type);
+	} else if (NULL != p->curdive)
+		fprintf(stderr, "%s:%zu:%zu: %s", p->file,
+			p->curdive->line, p->curdive->col, type);
+	else
+		fprintf(stderr, "%s: %s", p->file, type);
+}
+
 static void
 logerrx(struct parse *p, const char *fmt, ...)
 {
 	va_list	 ap;
 
-	fprintf(stderr, "%s:%zu:%zu: error: ", p->file,
-		XML_GetCurrentLineNumber(p->p),
-		XML_GetCurrentColumnNumber(p->p));
+	flockfile(stderr);
+	logpos(p, "error: ");
 	va_start(ap, fmt);
 	vfprintf(stderr, fmt, ap);
 	va_end(ap);
 	fputc('\n', stderr);
-	XML_StopParser(p->p, 0);
+	funlockfile(stderr);
+	if (NULL != p->p)
+		XML_StopParser(p->p, 0);
 }
 
 static void
-logattr(const struct parse *p, const char *tag, const char *attr)
+logattr(struct parse *p, const char *tag, const char *attr)
 {
 
 	logwarnx(p, "unknown <%s> attribute: %s", tag, attr);
@@ -132,17 +620,18 @@ lognattr(struct parse *p, const char *tag, const char *attr)
 }
 
 static void
-logwarnx(const struct parse *p, const char *fmt, ...)
+logwarnx(struct parse *p, const char *fmt, ...)
 {
 	va_list	 ap;
 
-	fprintf(stderr, "%s:%zu:%zu: warning: ", p->file,
-		XML_GetCurrentLineNumber(p->p),
-		XML_GetCurrentColumnNumber(p->p));
+	p->warns++;
+	flockfile(stderr);
+	logpos(p, "warning: ");
 	va_start(ap, fmt);
 	vfprintf(stderr, fmt, ap);
 	va_end(ap);
 	fputc('\n', stderr);
+	funlockfile(stderr);
 }
 
 static void
@@ -153,13 +642,13 @@ logdbg(const struct parse *p, const char *fmt, ...)
 	if ( ! verbose)
 		return;
 
-	fprintf(stderr, "%s:%zu:%zu: ", p->file,
-		XML_GetCurrentLineNumber(p->p),
-		XML_GetCurrentColumnNumber(p->p));
+	flockfile(stderr);
+	logpos(p, "");
 	va_start(ap, fmt);
 	vfprintf(stderr, fmt, ap);
 	va_end(ap);
 	fputc('\n', stderr);
+	funlockfile(stderr);
 }
 
 static void
@@ -168,10 +657,8 @@ logfatal(const struct parse *p, const char *fmt, ...)
 	va_list	 ap;
 	int	 er = errno;
 
-	fprintf(stderr, "%s:%zu:%zu: fatal: ", p->file,
-		XML_GetCurrentLineNumber(p->p),
-		XML_GetCurrentColumnNumber(p->p));
-
+	flockfile(stderr);
+	logpos(p, "fatal: ");
 	if (NULL != fmt) {
 		va_start(ap, fmt);
 		vfprintf(stderr, fmt, ap);
@@ -180,6 +667,7 @@ logfatal(const struct parse *p, const char *fmt, ...)
 	}
 
 	fprintf(stderr, "%s\n", strerror(er));
+	funlockfile(stderr);
 	exit(EXIT_FAILURE);
 }
 
@@ -222,6 +710,263 @@ xstrdup(const struct parse *p, const char *cp)
 	return(pp);
 }
 
+/*
+ * Parse a decimal integer, with leading white-space and sign, into
+ * "v", as the sscanf(3) "%d" conversion would.
+ * Returns a pointer past the digits or NULL if there are none or the
+ * value is unreasonably large.
+ */
+static const char *
+dtnum(const char *cp, int *v)
+{
+	long	 n = 0;
+	int	 neg = 0, nd = 0;
+
+	while (' ' == *cp || ('\t' <= *cp && *cp <= '\r'))
+		cp++;
+	if ('-' == *cp || '+' == *cp)
+		neg = '-' == *cp++;
+	for ( ; *cp >= '0' && *cp <= '9'; cp++, nd++)
+		if ((n = n * 10 + (*cp - '0')) > INT_MAX / 2)
+			return NULL;
+	if (0 == nd)
+		return NULL;
+	*v = neg ? -n : n;
+	return cp;
+}
+
+/*
+ * Look up (or fill in) the day "year", "mon", and "mday" (as in
+ * "struct tm") in "c".
+ * Returns the day only if it's a plain one: its local midnight exists,
+ * it lasts 24 hours, and the UTC offset is the same at either end.
+ * Otherwise, including for dates that mktime(3) would normalise and
+ * days around DST transitions, returns NULL.
+ */
+static const struct dtday *
+dtday_get(struct dtcache *c, int year, int mon, int mday)
+{
+	struct dtday	*dd;
+	struct tm	 tm, next;
+	time_t		 end;
+	size_t		 i;
+
+	i = ((size_t)year * 12 + (size_t)mon) * 31 + (size_t)mday;
+	i %= DTCACHE_SZ;
+	dd = &c->days[i];
+	c->last = i;
+
+	if (dd->mday == mday && dd->mon == mon && dd->year == year)
+		return dd->plain ? dd : NULL;
+
+	memset(&tm, 0, sizeof(struct tm));
+	tm.tm_year = year;
+	tm.tm_mon = mon;
+	tm.tm_mday = mday;
+	tm.tm_isdst = -1;
+	next = tm;
+	next.tm_mday++;
+
+	dd->mday = 0;
+	if (-1 == (dd->start = mktime(&tm)) ||
+	    -1 == (end = mktime(&next)))
+		return NULL;
+	if (tm.tm_year != year || tm.tm_mon != mon || tm.tm_mday != mday)
+		return NULL;
+
+	dd->year = year;
+	dd->mon = mon;
+	dd->mday = mday;
+	dd->wday = tm.tm_wday;
+	dd->yday = tm.tm_yday;
+	dd->isdst = tm.tm_isdst;
+	dd->plain = 0 == tm.tm_hour && 0 == tm.tm_min &&
+		0 == tm.tm_sec && 60 * 60 * 24 == end - dd->start &&
+		tm.tm_isdst == next.tm_isdst;
+	return dd->plain ? dd : NULL;
+}
+
+/*
+ * Set the fingerprint of "d" to "sz" bytes of "cp", or unset it if
+ * "cp" is NULL, with its length and (FNV-1a) hash.
+ */
+static void
+dive_fprint(const struct parse *p, struct dive *d, const char *cp, size_t sz)
+{
+	uint64_t	 h = FPHASH_BASIS;
+	size_t		 i;
+
+	free(d->fprint);
+	d->fprint = NULL;
+	d->fprintsz = 0;
+	d->fprinthash = 0;
+	if (NULL == cp)
+		return;
+
+	d->fprint = xstrndup(p, cp, sz);
+	d->fprintsz = sz;
+	for (i = 0; i < sz; i++)
+		h = (h ^ (unsigned char)cp[i]) * FPHASH_PRIME;
+	d->fprinthash = h;
+}
+
+/*
+ * Allocate "nm" zeroed members of size "sz" from the dive's chunks,
+ * creating a new chunk if the current one hasn't enough room.
+ * Returns NULL on failure (overflow or memory exhaustion).
+ */
+static void *
+arena_alloc(struct dive *d, size_t nm, size_t sz)
+{
+	struct dchunk	*c = d->arena;
+	size_t		 len, off, csz;
+
+	if ((nm >= MUL_NO_OVERFLOW || sz >= MUL_NO_OVERFLOW) &&
+	    nm > 0 && SIZE_MAX / nm < sz) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	len = nm * sz;
+
+	if (NULL != c) {
+		off = (c->used + DCHUNK_ALIGN - 1) & 
+			~(size_t)(DCHUNK_ALIGN - 1);
+		if (off <= c->size && c->size - off >= len) {
+			c->used = off + len;
+			c->last = off;
+			memset(c->buf + off, 0, len);
+			return c->buf + off;
+		}
+	}
+
+	/* Grow geometrically, but always fit the request. */
+
+	csz = NULL == c ? DCHUNK_MIN : c->size * 2;
+	if (csz > DCHUNK_MAX)
+		csz = DCHUNK_MAX;
+	if (csz < len)
+		csz = len;
+	if (csz > SIZE_MAX - sizeof(struct dchunk)) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	if (NULL == (c = malloc(sizeof(struct dchunk) + csz)))
+		return NULL;
+	c->next = d->arena;
+	c->size = csz;
+	c->used = len;
+	c->last = 0;
+	d->arena = c;
+	memset(c->buf, 0, len);
+	return c->buf;
+}
+
+/*
+ * Resize an array of "onm" members (of size "sz") allocated from the
+ * dive's chunks to "nm" members, zeroing any new members.
+ * If the array was the last allocation, it's grown in place.
+ * Otherwise, it's copied into new memory.
+ * Returns NULL on failure (overflow or memory exhaustion).
+ */
+static void *
+arena_realloc(struct dive *d, void *ptr, size_t onm, size_t nm, size_t sz)
+{
+	struct dchunk	*c = d->arena;
+	void		*np;
+	size_t		 len, olen;
+
+	if (NULL == ptr)
+		return arena_alloc(d, nm, sz);
+
+	if ((nm >= MUL_NO_OVERFLOW || sz >= MUL_NO_OVERFLOW) &&
+	    nm > 0 && SIZE_MAX / nm < sz) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	len = nm * sz;
+	olen = onm * sz;
+
+	if (NULL != c && 
+	    (unsigned char *)ptr == c->buf + c->last &&
+	    c->size - c->last >= len) {
+		if (len > olen)
+			memset(c->buf + c->last + olen, 0, len - olen);
+		c->used = c->last + len;
+		return ptr;
+	}
+
+	if (NULL == (np = arena_alloc(d, nm, sz)))
+		return NULL;
+	memcpy(np, ptr, olen < len ? olen : len);
+	return np;
+}
+
+static void
+arena_free(struct dive *d)
+{
+	struct dchunk	*c;
+
+	while (NULL != (c = d->arena)) {
+		d->arena = c->next;
+		free(c);
+	}
+}
+
+static void *
+xarena_calloc(const struct parse *p, struct dive *d, size_t nm, size_t sz)
+{
+	void	*pp;
+
+	if (NULL == (pp = arena_alloc(d, nm, sz)))
+		logfatal(p, "arena_alloc");
+	return pp;
+}
+
+static void *
+xarena_reallocarray(const struct parse *p, struct dive *d, 
+	void *ptr, size_t onm, size_t nm, size_t sz)
+{
+
+	if (NULL == (ptr = arena_realloc(d, ptr, onm, nm, sz)))
+		logfatal(p, "arena_realloc");
+	return ptr;
+}
+
+static void *
+xarena_memdup(const struct parse *p, 
+	struct dive *d, const void *cp, size_t sz)
+{
+	void	*pp;
+
+	pp = xarena_calloc(p, d, sz, 1);
+	memcpy(pp, cp, sz);
+	return pp;
+}
+
+/*
+ * Like strtonum(3), but quickly handling plain digit strings, which is
+ * all that we write.
+ */
+static long long
+xstrtonum(const char *val, long long minval, 
+	long long maxval, const char **er)
+{
+	const char	*cp;
+	long long	 v = 0;
+
+	/* Eighteen digits can't overflow. */
+
+	for (cp = val; cp - val < 18 && *cp >= '0' && *cp <= '9'; cp++)
+		v = v * 10 + (*cp - '0');
+	if (cp != val && '\0' == *cp && v >= minval && v <= maxval) {
+		*er = NULL;
+		return v;
+	}
+
+	return strtonum(val, minval, maxval, er);
+}
+
 /*
  * Convert "val" to a double leaving it as 0.0 upon conversion errors.
  * Return zero on failure, non-zero on success (the pointer will be set
@@ -232,7 +977,8 @@ xstrtod(const char *val, double *res)
 {
 	char		 *ep;
 
-	*res = strtod(val, &ep);
+	errno = 0;
+	*res = divecmd_strtod(val, &ep);
 	if (ep == val || ERANGE == errno) {
 		*res = 0.0;
 		return 0;
@@ -252,90 +998,63 @@ logerrp(struct parse *p)
 }
 
 /*
- * Some group sortings need to be sorted /after/ the whole dive has been
- * processed---for example, when sorting by maximum depth that can only
- * be ascertained after all samples have been read.
- * This should be called when closing out a dive.
+ * Some group sortings can only be keyed /after/ the whole dive has been
+ * processed---for example, maximum depth, which is only known after all
+ * samples have been read.
+ * This records the key used by dives_sort() to order the group once the
+ * file has been parsed, and should be called when closing out a dive.
+ * In reverse sorts, a dive with a zero key (no samples) is keyed by the
+ * group's least non-zero key so far, or DBL_MAX if there's none, so
+ * that it keeps its place behind the dives already in the group.
  */
 static void
-group_readd(struct parse *p, struct dive *d)
+group_key(struct parse *p, struct dive *d)
 {
-	struct dive	*dp;
+	struct dgroup	*dg = d->group;
+	double		 key;
 
-	assert(NULL != d->group);
+	assert(NULL != dg);
 
-	/* Date-time is a pre-processing thing, so nothing to do. */
-
-	if (GROUPSORT_DATETIME == p->stat->groupsort)
+	switch (p->stat->groupsort) {
+	case GROUPSORT_DATETIME:
 		return;
-
-	/* Start by removing, then we'll re-add. */
-
-	TAILQ_REMOVE(&d->group->dives, d, gentries);
-
-	if (GROUPSORT_MAXTIME == p->stat->groupsort) {
-		TAILQ_FOREACH(dp, &d->group->dives, gentries)
-			if (dp->maxtime &&
-			    dp->maxtime > d->maxtime)
-				break;
-	} else if (GROUPSORT_RMAXTIME == p->stat->groupsort) {
-		TAILQ_FOREACH(dp, &d->group->dives, gentries)
-			if (dp->maxtime &&
-			    dp->maxtime < d->maxtime)
-				break;
-	} else if (GROUPSORT_RMAXDEPTH == p->stat->groupsort) {
-		TAILQ_FOREACH(dp, &d->group->dives, gentries)
-			if (dp->maxdepth &&
-			    dp->maxdepth < d->maxdepth)
-				break;
-	} else {
-		TAILQ_FOREACH(dp, &d->group->dives, gentries)
-			if (dp->maxdepth &&
-			    dp->maxdepth > d->maxdepth)
-				break;
+	case GROUPSORT_MAXTIME:
+	case GROUPSORT_RMAXTIME:
+		key = d->maxtime;
+		break;
+	default:
+		key = d->maxdepth;
+		break;
 	}
 
-	if (NULL == dp)
-		TAILQ_INSERT_TAIL(&d->group->dives, d, gentries);
+	if (0.0 != key) {
+		if (0.0 == dg->keymin || key < dg->keymin)
+			dg->keymin = key;
+		d->gkey = key;
+	} else if (GROUPSORT_RMAXTIME == p->stat->groupsort ||
+	    GROUPSORT_RMAXDEPTH == p->stat->groupsort)
+		d->gkey = 0.0 == dg->keymin ? DBL_MAX : dg->keymin;
 	else
-		TAILQ_INSERT_BEFORE(dp, d, gentries);
+		d->gkey = 0.0;
 }
 
 /*
  * Add the dive "d" to the group "i" (which must exist) indexing in the
  * array of groups.
  * Returns the group (never NULL).
- * This inserts the groups in sorted error, if applicable.
- * Be sure to group_readd after closing out the dive, because some
+ * The dive is appended: dives_sort() orders the group once the file has
+ * been parsed.
+ * Be sure to group_key() after closing out the dive, because some
  * sorting criteria are post-processed (e.g., maximum depth).
  */
 static struct dgroup *
 group_add(struct parse *p, size_t i, struct dive *d)
 {
-	struct dive	*dp = NULL;
 	struct dgroup	*dg = p->stat->groups[i];
 
 	d->group = dg;
 	dg->ndives++;
-
-	/* All other sorting types need group_readd(). */
-
-	if (GROUPSORT_DATETIME == p->stat->groupsort) {
-		if (0 == d->datetime) {
-			TAILQ_INSERT_TAIL(&dg->dives, d, gentries);
-			return(dg);
-		}
-		TAILQ_FOREACH(dp, &dg->dives, gentries)
-			if (dp->datetime &&
-			    dp->datetime > d->datetime)
-				break;
-	}
-
-	if (NULL == dp)
-		TAILQ_INSERT_TAIL(&dg->dives, d, gentries);
-	else
-		TAILQ_INSERT_BEFORE(dp, d, gentries);
-
+	TAILQ_INSERT_TAIL(&dg->dives, d, gentries);
 	return(dg);
 }
 
@@ -364,9 +1083,96 @@ group_alloc(struct parse *p, struct dive *d, const char *date)
 
 	TAILQ_INIT(&p->stat->groups[i]->dives);
 	p->stat->groups[i]->id = i;
+	p->stat->groups[i]->log = d->log;
 	return(group_add(p, i, d));
 }
 
+/*
+ * FNV-1a hash of a nul-terminated string (including the nul) onto "h".
+ * A NULL string hashes differently from an empty one.
+ */
+static unsigned int
+hash_str(unsigned int h, const char *cp)
+{
+
+	if (NULL == cp)
+		return (h ^ 0xff) * GROUPHASH_PRIME;
+	do
+		h = (h ^ (unsigned char)*cp) * GROUPHASH_PRIME;
+	while ('\0' != *cp++);
+	return h;
+}
+
+static unsigned int
+hash_dlog(const struct dlog *dl)
+{
+	unsigned int	 h = GROUPHASH_BASIS;
+
+	h = hash_str(h, dl->vendor);
+	h = hash_str(h, dl->product);
+	h = hash_str(h, dl->model);
+	return hash_str(h, dl->ident);
+}
+
+/*
+ * Compare two optional strings.
+ * Returns zero if both are NULL or both are equal.
+ */
+static int
+strcmp_null(const char *a, const char *b)
+{
+
+	if (NULL == a || NULL == b)
+		return NULL != a || NULL != b;
+	return strcmp(a, b);
+}
+
+/*
+ * Whether the divelogs have the same diver and dive computer.
+ */
+static int
+dlog_eq(const struct dlog *a, const struct dlog *b)
+{
+
+	return 0 == strcmp_null(a->vendor, b->vendor) &&
+		0 == strcmp_null(a->model, b->model) &&
+		0 == strcmp_null(a->product, b->product) &&
+		0 == strcmp_null(a->ident, b->ident);
+}
+
+/*
+ * Insert the group into the open-addressed (linear probing) map of
+ * groups, growing the map to keep it at most half full.
+ */
+static void
+groupmap_insert(struct parse *p, struct dgroup *dg)
+{
+	struct divestat	 *st = p->stat;
+	struct dgroup	**map;
+	size_t		  i, j, sz;
+
+	if (2 * st->groupsz > st->groupmapsz) {
+		sz = 0 == st->groupmapsz ? 16 : 2 * st->groupmapsz;
+		map = xcalloc(p, sz, sizeof(struct dgroup *));
+		for (i = 0; i < st->groupmapsz; i++) {
+			if (NULL == st->groupmap[i])
+				continue;
+			j = st->groupmap[i]->hash & (sz - 1);
+			while (NULL != map[j])
+				j = (j + 1) & (sz - 1);
+			map[j] = st->groupmap[i];
+		}
+		free(st->groupmap);
+		st->groupmap = map;
+		st->groupmapsz = sz;
+	}
+
+	j = dg->hash & (st->groupmapsz - 1);
+	while (NULL != st->groupmap[j])
+		j = (j + 1) & (st->groupmapsz - 1);
+	st->groupmap[j] = dg;
+}
+
 /*
  * Get or create a group by the given "name", which might be, say, the
  * date or the diver (it doesn't matter).
@@ -375,69 +1181,65 @@ group_alloc(struct parse *p, struct dive *d, const char *date)
 static struct dgroup *
 group_lookup_name(struct parse *p, struct dive *d, const char *name)
 {
-	size_t	 i;
+	struct divestat	*st = p->stat;
+	struct dgroup	*dg;
+	unsigned int	 h;
+	size_t		 i;
 
-	for (i = 0; i < p->stat->groupsz; i++)
-		if (0 == strcmp(name, p->stat->groups[i]->name))
-			break;
-	if (i == p->stat->groupsz && verbose)
+	h = hash_str(GROUPHASH_BASIS, name);
+
+	if (st->groupmapsz) {
+		i = h & (st->groupmapsz - 1);
+		for ( ; NULL != (dg = st->groupmap[i]); 
+		     i = (i + 1) & (st->groupmapsz - 1))
+			if (h == dg->hash && 0 == strcmp(name, dg->name))
+				return(group_add(p, dg->id, d));
+	}
+
+	if (verbose && ! p->quiet)
 		fprintf(stderr, "%s: new group: %s\n", p->file, name);
 
-	return((i == p->stat->groupsz) ?
-		group_alloc(p, d, name) :
-		group_add(p, i, d));
+	dg = group_alloc(p, d, name);
+	dg->hash = h;
+	groupmap_insert(p, dg);
+	return(dg);
 }
 
 /*
  * Look for a group registered with the same divelog.
  * It must be identical: diver, vendor, product, etc.
- * Return a pointer to the group or NULL.
+ * The last divelog's group is cached, as all of its dives will be in
+ * the same group.
+ * Returns the created or augmented group.
  */
 static struct dgroup *
 group_lookup_divelog(struct parse *p, struct dive *d)
 {
+	struct divestat		*st = p->stat;
 	struct dgroup 		*dg;
-	const struct dlog	*dl;
+	unsigned int		 h;
 	size_t			 i;
 
-	for (i = 0; i < p->stat->groupsz; i++) {
-		dg = p->stat->groups[i];
-		assert(dg->ndives);
-		assert(NULL != TAILQ_FIRST(&dg->dives));
-		dl = TAILQ_FIRST(&dg->dives)->log;
-
-		if (NULL == dl->vendor && NULL != d->log->vendor)
-			continue;
-		if (NULL != dl->vendor && NULL == d->log->vendor)
-			continue;
-		if (NULL != dl->vendor &&
-	 	    strcmp(dl->vendor, d->log->vendor))
-			continue;
-		if (NULL == dl->model && NULL != d->log->model)
-			continue;
-		if (NULL != dl->model && NULL == d->log->model)
-			continue;
-		if (NULL != dl->model &&
-	 	    strcmp(dl->model, d->log->model))
-			continue;
-		if (NULL == dl->product && NULL != d->log->product)
-			continue;
-		if (NULL != dl->product && NULL == d->log->product)
-			continue;
-		if (NULL != dl->product &&
-	 	    strcmp(dl->product, d->log->product))
-			continue;
-		if (NULL == dl->ident && NULL != d->log->ident)
-			continue;
-		if (NULL != dl->ident && NULL == d->log->ident)
-			continue;
-		if (NULL != dl->ident &&
-	 	    strcmp(dl->ident, d->log->ident))
-			continue;
-		return(group_add(p, i, d));
+	if (NULL != p->loggroup)
+		return(group_add(p, p->loggroup->id, d));
+
+	h = hash_dlog(d->log);
+
+	if (st->groupmapsz) {
+		i = h & (st->groupmapsz - 1);
+		for ( ; NULL != (dg = st->groupmap[i]); 
+		     i = (i + 1) & (st->groupmapsz - 1)) {
+			if (h != dg->hash)
+				continue;
+			assert(NULL != dg->log);
+			if ( ! dlog_eq(dg->log, d->log))
+				continue;
+			p->loggroup = dg;
+			return(group_add(p, dg->id, d));
+		}
 	}
 
-	if (verbose)
+	if (verbose && ! p->quiet)
 		fprintf(stderr, "%s: new group: %s, %s, %s, %s\n", 
 			p->file, 
 			NULL == d->log->ident ?
@@ -449,40 +1251,160 @@ group_lookup_divelog(struct parse *p, struct dive *d)
 			NULL == d->log->model ?
 			"(no model)" : d->log->model);
 
-	return(group_alloc(p, d, NULL));
+	dg = group_alloc(p, d, NULL);
+	dg->hash = h;
+	groupmap_insert(p, dg);
+	p->loggroup = dg;
+	return(dg);
 }
 
+/*
+ * Hexadecimal digit values plus one, or zero for non-digits.
+ */
+static	const unsigned char unhex[256] = {
+	['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5,
+	['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+	['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15,
+	['f'] = 16, ['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14,
+	['E'] = 15, ['F'] = 16
+};
+
+/*
+ * Hexadecimal digits for encoding.
+ */
+static	const char hexdigs[] = "0123456789abcdef";
+
+/*
+ * Make room for "len" more bytes of text in the parse buffer.
+ * The buffer grows geometrically and is kept for the whole parse:
+ * elements reset "bufsz" when done with it.
+ */
 static void
-parse_text(void *dat, const XML_Char *s, int len)
+buf_grow(struct parse *p, size_t len)
 {
-	struct parse	*p = dat;
+	size_t	 max;
+	char	*pp;
 
-	if (0 == len)
+	if (p->bufmax - p->bufsz >= len)
 		return;
-	p->buf = realloc(p->buf, p->bufsz + len);
-	if (NULL == p->buf)
+	max = p->bufmax ? p->bufmax : 256;
+	while (max - p->bufsz < len) {
+		if (max > SIZE_MAX / 2)
+			logfatal(p, "buf_grow");
+		max *= 2;
+	}
+	if (NULL == (pp = realloc(p->buf, max)))
 		logfatal(p, "realloc");
-	memcpy(p->buf + p->bufsz, s, len);
-	p->bufsz += len;
+	p->buf = pp;
+	p->bufmax = max;
 }
 
+/*
+ * Decode <vendor> hexadecimal text into bytes as it's read.
+ * White-space between digits is ignored.
+ * Anything else is warned about once and the data is dropped.
+ */
 static void
-parse_tank(struct parse *p, const XML_Char **atts)
+parse_vendor_text(void *dat, const XML_Char *s, int len)
 {
-	struct dive	 *d = p->curdive;
+	struct parse	*p = dat;
+	unsigned char	 v;
+	int		 i;
+
+	if (0 == len || p->vendorbad)
+		return;
+	buf_grow(p, len / 2 + 1);
+
+	for (i = 0; i < len; i++) {
+		if (0 != (v = unhex[(unsigned char)s[i]])) {
+			if (0 == p->nibble) {
+				p->nibble = v;
+				continue;
+			}
+			p->buf[p->bufsz++] = 
+				((p->nibble - 1) << 4) | (v - 1);
+			p->nibble = 0;
+		} else if (' ' != s[i] && '\t' != s[i] &&
+		    '\n' != s[i] && '\r' != s[i]) {
+			logwarnx(p, "malformed <vendor> data: ignoring");
+			p->vendorbad = 1;
+			p->bufsz = 0;
+			return;
+		}
+	}
+}
+
+static void
+parse_text(void *dat, const XML_Char *s, int len)
+{
+	struct parse	*p = dat;
+
+	if (0 == len)
+		return;
+	buf_grow(p, len);
+	memcpy(p->buf + p->bufsz, s, len);
+	p->bufsz += len;
+}
+
+static void
+numset_add(struct numset *set, size_t num)
+{
+
+	if (num < NUMSET_MAX)
+		set->bits[num / 8] |= 1U << (num % 8);
+}
+
+/*
+ * See if the dive "d" has a gas "num", where "set" has the numbers of
+ * all of its gases.
+ */
+static int
+gas_exists(const struct dive *d, const struct numset *set, size_t num)
+{
+	size_t	 i;
+
+	if (num < NUMSET_MAX)
+		return 0 != (set->bits[num / 8] & (1U << (num % 8)));
+	for (i = 0; i < d->gassz; i++)
+		if (num == d->gas[i].num)
+			return 1;
+	return 0;
+}
+
+/*
+ * Like gas_exists(), but for the cylinder "num".
+ */
+static int
+cyl_exists(const struct dive *d, const struct numset *set, size_t num)
+{
+	size_t	 i;
+
+	if (num < NUMSET_MAX)
+		return 0 != (set->bits[num / 8] & (1U << (num % 8)));
+	for (i = 0; i < d->cylsz; i++)
+		if (num == d->cyls[i].num)
+			return 1;
+	return 0;
+}
+
+static void
+parse_tank(struct parse *p, const XML_Char **atts)
+{
+	struct dive	 *d = p->curdive;
 	const char	 *tank = NULL, *mix = NULL, *er,
 	      	 	 *vol = NULL, *wp = NULL;
 	const XML_Char	**ap;
 	size_t		  i;
+	enum token	  tok;
 
 	for (ap = atts; NULL != ap[0]; ap += 2)
-		if (0 == strcmp(*ap, "num"))
+		if (TOKEN_num == (tok = divecmd_token(*ap)))
 			tank = ap[1];
-		else if (0 == strcmp(*ap, "gasmix"))
+		else if (TOKEN_gasmix == tok)
 			mix = ap[1];
-		else if (0 == strcmp(*ap, "volume"))
+		else if (TOKEN_volume == tok)
 			vol = ap[1];
-		else if (0 == strcmp(*ap, "workpressure"))
+		else if (TOKEN_workpressure == tok)
 			wp = ap[1];
 		else
 			logattr(p, "tank", *ap);
@@ -492,7 +1414,7 @@ parse_tank(struct parse *p, const XML_Char **atts)
 		return;
 	}
 
-	i = strtonum(tank, 0, LONG_MAX, &er);
+	i = xstrtonum(tank, 0, LONG_MAX, &er);
 	if (NULL != er) {
 		logerrx(p, "malformed <tank> num: %s", tank);
 		return;
@@ -504,7 +1426,7 @@ parse_tank(struct parse *p, const XML_Char **atts)
 	d->cyls[d->cylsz].num = i;
 
 	if (NULL != mix) {
-		i = strtonum(mix, 0, LONG_MAX, &er);
+		i = xstrtonum(mix, 0, LONG_MAX, &er);
 		if (NULL != er) {
 			logerrx(p, "malformed <tank> mix: %s", mix);
 			return;
@@ -530,16 +1452,17 @@ parse_gasmix(struct parse *p, const XML_Char **atts)
 	const char	 *v, *er;
 	const XML_Char	**ap;
 	size_t		  i;
+	enum token	  tok;
 
 	v = mixes[0] = mixes[1] = mixes[2] = NULL;
 	for (ap = atts; NULL != ap[0]; ap += 2)
-		if (0 == strcmp(*ap, "num"))
+		if (TOKEN_num == (tok = divecmd_token(*ap)))
 			v = ap[1];
-		else if (0 == strcmp(*ap, "o2"))
+		else if (TOKEN_o2 == tok)
 			mixes[0] = ap[1];
-		else if (0 == strcmp(*ap, "n2"))
+		else if (TOKEN_n2 == tok)
 			mixes[1] = ap[1];
-		else if (0 == strcmp(*ap, "he"))
+		else if (TOKEN_he == tok)
 			mixes[2] = ap[1];
 		else
 			logattr(p, "gasmix", *ap);
@@ -549,7 +1472,7 @@ parse_gasmix(struct parse *p, const XML_Char **atts)
 		return;
 	}
 
-	i = strtonum(v, 0, LONG_MAX, &er);
+	i = xstrtonum(v, 0, LONG_MAX, &er);
 	if (NULL != er) {
 		logerrx(p, "malformed <gasmix> num: %s", v);
 		return;
@@ -559,6 +1482,7 @@ parse_gasmix(struct parse *p, const XML_Char **atts)
 		d->gassz + 1, sizeof(struct divegas));
 	memset(&d->gas[d->gassz], 0, sizeof(struct divegas));
 	d->gas[d->gassz].num = i;
+	numset_add(&p->gasnums, i);
 
 	if (NULL != mixes[0] &&
 	    ! xstrtod(mixes[0], &d->gas[d->gassz].o2))
@@ -583,11 +1507,13 @@ parse_pressure(struct parse *p, const XML_Char **atts)
 	const char	 *num = NULL, *v = NULL, *er;
 	const XML_Char	**ap;
 	struct samp	 *s = p->cursamp;
+	struct samppres	  pres;
+	enum token	  tok;
 
 	for (ap = atts; NULL != ap[0]; ap += 2)
-		if (0 == strcmp(*ap, "value"))
+		if (TOKEN_value == (tok = divecmd_token(*ap)))
 			v = ap[1];
-		else if (0 == strcmp(*ap, "tank"))
+		else if (TOKEN_tank == tok)
 			num = ap[1];
 		else
 			logattr(p, "pressure", *ap);
@@ -600,23 +1526,25 @@ parse_pressure(struct parse *p, const XML_Char **atts)
 		return;
 	}
 
-	s->pressure = xreallocarray
-		(p, s->pressure,
-		 s->pressuresz + 1,
-		 sizeof(struct samppres));
-	s->pressuresz++;
-
-	if ( ! xstrtod(v, &s->pressure[s->pressuresz - 1].pressure)) {
+	if ( ! xstrtod(v, &pres.pressure)) {
 		logerrx(p, "malformed <pressure> value: %s", v);
 		return;
 	}
 
-	s->pressure[s->pressuresz - 1].tank = strtonum
-		(num, 0, LONG_MAX, &er);
+	pres.tank = xstrtonum(num, 0, LONG_MAX, &er);
 	if (NULL != er) {
 		logerrx(p, "bad <pressure> tank");
 		return;
 	}
+
+	if (p->stat->summary || ! (WANT_PRESSURE & p->stat->want))
+		return;
+
+	s->pressure = xarena_reallocarray
+		(p, p->curdive, s->pressure,
+		 s->pressuresz, s->pressuresz + 1,
+		 sizeof(struct samppres));
+	s->pressure[s->pressuresz++] = pres;
 }
 
 static void
@@ -625,14 +1553,15 @@ parse_event(struct parse *p, const XML_Char **atts)
 	const XML_Char	**ap;
 	struct samp	 *s = p->cursamp;
 	const char	 *v = NULL, *dur = NULL, *fl = NULL, *er;
-	enum event	  evt;
+	struct sampevent  ev;
+	enum token	  tok;
 
 	for (ap = atts; NULL != ap[0]; ap += 2)
-		if (0 == strcmp(*ap, "type"))
+		if (TOKEN_type == (tok = divecmd_token(*ap)))
 			v = ap[1];
-		else if (0 == strcmp(*ap, "duration"))
+		else if (TOKEN_duration == tok)
 			dur = ap[1];
-		else if (0 == strcmp(*ap, "flags"))
+		else if (TOKEN_flags == tok)
 			fl = ap[1];
 		else
 			logattr(p, "event", *ap);
@@ -642,36 +1571,36 @@ parse_event(struct parse *p, const XML_Char **atts)
 		return;
 	}
 
-	for (evt = 0; evt < EVENT__MAX; evt++)
-		if (0 == strcmp(v, events[evt]))
+	memset(&ev, 0, sizeof(struct sampevent));
+
+	for (ev.type = 0; ev.type < EVENT__MAX; ev.type++)
+		if (0 == strcmp(v, events[ev.type]))
 			break;
 
-	if (EVENT__MAX == evt) {
+	if (EVENT__MAX == ev.type) {
 		logerrx(p, "unknown <event> type");
 		return;
 	}
 
-	s->events = xreallocarray
-		(p, s->events, 
-		 s->eventsz + 1,
-		 sizeof(struct sampevent));
-	memset(&s->events[s->eventsz], 0,
-		sizeof(struct sampevent));
-	s->events[s->eventsz].type = evt;
-	s->eventsz++;
-
 	if (NULL != dur) {
-		s->events[s->eventsz - 1].duration = 
-			strtonum(dur, 0, LONG_MAX, &er);
+		ev.duration = xstrtonum(dur, 0, LONG_MAX, &er);
 		if (NULL != er)
 			logerrx(p, "bad <event> duration: %s", er);
 	}
 	if (NULL != fl) {
-		s->events[s->eventsz - 1].flags = 
-			strtonum(fl, 0, LONG_MAX, &er);
+		ev.flags = xstrtonum(fl, 0, LONG_MAX, &er);
 		if (NULL != er)
 			logerrx(p, "bad <event> flags: %s", er);
 	}
+
+	if (p->stat->summary || ! (WANT_EVENTS & p->stat->want))
+		return;
+
+	s->events = xarena_reallocarray
+		(p, p->curdive, s->events, 
+		 s->eventsz, s->eventsz + 1,
+		 sizeof(struct sampevent));
+	s->events[s->eventsz++] = ev;
 }
 
 static void
@@ -681,13 +1610,14 @@ parse_deco(struct parse *p, const XML_Char **atts)
 	struct samp	*samp = p->cursamp;
 	const char	*depth = NULL, *mode = NULL, 
 	     		*dur = NULL, *er;
+	enum token	 tok;
 
 	for (ap = atts; NULL != ap[0]; ap += 2) 
-		if (0 == strcmp(*ap, "depth"))
+		if (TOKEN_depth == (tok = divecmd_token(*ap)))
 			depth = ap[1];
-		else if (0 == strcmp(*ap, "type"))
+		else if (TOKEN_type == tok)
 			mode = ap[1];
-		else if (0 == strcmp(*ap, "duration"))
+		else if (TOKEN_duration == tok)
 			dur = ap[1];
 		else
 			logattr(p, "deco", *ap);
@@ -715,7 +1645,7 @@ parse_deco(struct parse *p, const XML_Char **atts)
 
 	if (NULL != dur) {
 		samp->deco.duration = 
-			strtonum(dur, 0, LONG_MAX, &er);
+			xstrtonum(dur, 0, LONG_MAX, &er);
 		if (NULL != er) {
 			logerrx(p, "malformed <deco> duration: %s", er);
 			return;
@@ -725,20 +1655,117 @@ parse_deco(struct parse *p, const XML_Char **atts)
 	samp->flags |= SAMP_DECO;
 }
 
+/*
+ * Convert the <dive> date and time into an epoch.
+ * Returns zero (after warning) if either is malformed.
+ */
+static time_t
+parse_datetime(struct parse *p, const char *date, const char *time)
+{
+	struct tm	 tm;
+	time_t		 t;
+
+	memset(&tm, 0, sizeof(struct tm));
+
+	if ( ! divecmd_date_parse(date, &tm)) {
+		logwarnx(p, "malformed <dive> date: %s", date);
+		return 0;
+	}
+	if ( ! divecmd_time_parse(time, &tm)) {
+		logwarnx(p, "malformed <dive> time: %s", time);
+		return 0;
+	}
+
+	if (-1 == (t = divecmd_mktime(&p->dates_tz, &tm))) {
+		logwarnx(p, "malformed <dive> "
+			"datetime: %s-%s", date, time);
+		return 0;
+	}
+
+	return t;
+}
+
+/*
+ * Register a new dive "d", with <dive> date attribute "date" (or NULL),
+ * with the statistics, its group, and the dive queue.
+ */
+static void
+dive_add(struct parse *p, struct dive *d, const char *date)
+{
+	struct dgroup	*grp;
+
+	/* Check against our global extrema. */
+
+	if (0 != d->datetime) {
+		if (0 == p->stat->timestamp_min ||
+		    d->datetime < p->stat->timestamp_min)
+			p->stat->timestamp_min = d->datetime;
+		if (0 == p->stat->timestamp_max ||
+		    d->datetime > p->stat->timestamp_max)
+			p->stat->timestamp_max = d->datetime;
+	}
+
+	/*
+	 * Now assign to our group.
+	 * Unless streaming, this is the file's own group: dives are
+	 * moved into the real groups by merge_file().
+	 */
+
+	if (GROUP_DATE == p->stat->group) {
+		if (NULL == date) {
+			logwarnx(p, "group <dive> without date");
+			grp = group_lookup_name(p, d, "");
+		} else
+			grp = group_lookup_name(p, d, date);
+	} else if (GROUP_DIVER == p->stat->group) {
+		if (NULL == d->log->ident) {
+			logwarnx(p, "group <dive> without diver");
+			grp = group_lookup_name(p, d, "");
+		} else
+			grp = group_lookup_name(p, d, d->log->ident);
+	} else if (GROUP_DIVELOG == p->stat->group) {
+		assert(NULL != d->log);
+		grp = group_lookup_divelog(p, d);
+		assert(NULL != grp);
+	} else {
+		if (0 == p->stat->groupsz && ! p->quiet)
+			logdbg(p, "new default group");
+		grp = (0 == p->stat->groupsz) ?
+			group_alloc(p, d, NULL) :
+			group_add(p, 0, d);
+	}
+
+	assert(NULL != grp);
+
+	/* 
+	 * Now register the dive with the file's dive queue.
+	 * It's ordered with the rest in dives_sort() after being
+	 * merged, as the group's start time may yet change.
+	 */
+
+	TAILQ_INSERT_TAIL(p->dives, d, entries);
+}
+
+static void dive_stub(struct parse *);
+
 static void
 parse_open(void *dat, const XML_Char *s, const XML_Char **atts)
 {
 	const XML_Char	**ap;
 	struct parse	 *p = dat;
 	struct samp	 *samp;
-	struct dive	 *d, *dp;
+	struct dive	 *d;
+	const struct idxdive *id;
 	const char	 *date, *time, *num, *er, *dur, *mode, *v;
-	struct tm	  tm;
-	int		  rc;
-	struct dgroup	 *grp;
 	size_t		  i;
+	double		  dv;
+	enum token	  tok, atok;
+
+	tok = divecmd_token(s);
+	if (2 == ++p->depth)
+		p->d2tok = tok;
 
-	if (0 == strcmp(s, "divelog")) {
+	if (TOKEN_divelog == tok) {
 		if (NULL != p->curlog) {
 			logerrx(p, "nested <divelog>");
 			return;
@@ -747,27 +1774,27 @@ parse_open(void *dat, const XML_Char *s, const XML_Char **atts)
 		p->curlog->file = xstrdup(p, p->file);
 		p->curlog->line = XML_GetCurrentLineNumber(p->p);
 		for (ap = atts; NULL != ap[0]; ap += 2)
-			if (0 == strcmp(*ap, "diver")) {
+			if (TOKEN_diver == (atok = divecmd_token(*ap))) {
 				free(p->curlog->ident);
 				p->curlog->ident = xstrdup(p, ap[1]);
-			} else if (0 == strcmp(*ap, "vendor")) {
+			} else if (TOKEN_vendor == atok) {
 				free(p->curlog->vendor);
 				p->curlog->vendor = xstrdup(p, ap[1]);
-			} else if (0 == strcmp(*ap, "product")) {
+			} else if (TOKEN_product == atok) {
 				free(p->curlog->product);
 				p->curlog->product = xstrdup(p, ap[1]);
-			} else if (0 == strcmp(*ap, "model")) {
+			} else if (TOKEN_model == atok) {
 				free(p->curlog->model);
 				p->curlog->model = xstrdup(p, ap[1]);
-			} else if (0 == strcmp(*ap, "program")) {
+			} else if (TOKEN_program == atok) {
 				free(p->curlog->program);
 				p->curlog->program = xstrdup(p, ap[1]);
-			} else if (0 != strcmp(*ap, "version"))
+			} else if (TOKEN_version != atok)
 				logattr(p, "divelog", *ap);
 
 		TAILQ_INSERT_TAIL(&p->stat->dlogs, p->curlog, entries);
 		logdbg(p, "new divelog");
-	} else if (0 == strcmp(s, "dive")) {
+	} else if (TOKEN_dive == tok) {
 		if (NULL != p->cursamp) {
 			logerrx(p, "<dive> within <sample>");
 			return;
@@ -779,24 +1806,65 @@ parse_open(void *dat, const XML_Char *s, const XML_Char **atts)
 			return;
 		}
 
+		/* Fill in the dives we've passed over. */
+
+		if (NULL != p->feed) {
+			while (p->feed->next < p->feed->divesz &&
+			    ! p->feed->chosen[p->feed->next])
+				dive_stub(p);
+			if (p->feed->next == p->feed->divesz) {
+				logerrx(p, "<dive> not in index");
+				return;
+			}
+		}
+
 		p->curdive = d = xcalloc(p, 1, sizeof(struct dive));
-		p->curdive->pid = ++p->pid;
-		p->curdive->line = XML_GetCurrentLineNumber(p->p);
-		p->curdive->col = XML_GetCurrentColumnNumber(p->p);
+		memset(&p->gasnums, 0, sizeof(struct numset));
+		if (NULL != p->feed) {
+			id = &p->feed->dives[p->feed->next++];
+			p->pid = p->feed->next - 1;
+			p->feed->line = XML_GetCurrentLineNumber(p->p);
+			p->feed->col = XML_GetCurrentColumnNumber(p->p);
+			d->line = id->line;
+			d->col = id->col;
+		} else {
+			d->line = XML_GetCurrentLineNumber(p->p);
+			d->col = XML_GetCurrentColumnNumber(p->p);
+		}
+		d->pid = ++p->pid;
 		TAILQ_INIT(&d->samps);
+
+		/*
+		 * Dives can be fed by themselves from the index only if
+		 * they're all directly within <divelog><dives>.
+		 */
+
+		if (p->indexing) {
+			if (3 != p->depth || TOKEN_dives != p->d2tok)
+				p->noidx = 1;
+			if (d->pid > p->rangesz) {
+				p->rangesz = 2 * d->pid;
+				p->ranges = xreallocarray(p, p->ranges,
+					p->rangesz, sizeof(struct irange));
+			}
+			p->ranges[d->pid - 1].off = 
+				XML_GetCurrentByteIndex(p->p);
+			p->ranges[d->pid - 1].len = 
+				XML_GetCurrentByteCount(p->p);
+		}
 		d->log = p->curlog;
 
 		num = dur = date = time = mode = NULL;
 		for (ap = atts; NULL != ap[0]; ap += 2)
-			if (0 == strcmp(*ap, "number"))
+			if (TOKEN_number == (atok = divecmd_token(*ap)))
 				num = ap[1];
-			else if (0 == strcmp(*ap, "duration"))
+			else if (TOKEN_duration == atok)
 				dur = ap[1];
-			else if (0 == strcmp(*ap, "date"))
+			else if (TOKEN_date == atok)
 				date = ap[1];
-			else if (0 == strcmp(*ap, "time"))
+			else if (TOKEN_time == atok)
 				time = ap[1];
-			else if (0 == strcmp(*ap, "mode"))
+			else if (TOKEN_mode == atok)
 				mode = ap[1];
 			else 
 				logattr(p, "dive", *ap);
@@ -816,7 +1884,7 @@ parse_open(void *dat, const XML_Char *s, const XML_Char **atts)
 		}
 
 		if (NULL != num) {
-			d->num = strtonum(num, 0, LONG_MAX, &er);
+			d->num = xstrtonum(num, 0, LONG_MAX, &er);
 			if (NULL != er) {
 				logwarnx(p, "malformed "
 					"<dive> number: %s", er);
@@ -826,115 +1894,26 @@ parse_open(void *dat, const XML_Char *s, const XML_Char **atts)
 		}
 
 		if (NULL != dur) {
-			d->duration = strtonum(dur, 0, LONG_MAX, &er);
+			d->duration = xstrtonum(dur, 0, LONG_MAX, &er);
 			if (NULL != er)
 				logwarnx(p, "dive duration: %s", er);
 		}
 
-		if (NULL != date && NULL != time) {
-			memset(&tm, 0, sizeof(struct tm));
-			rc = sscanf(date, "%d-%d-%d", 
-				&tm.tm_year, &tm.tm_mon, &tm.tm_mday);
-			if (3 != rc) {
-				logwarnx(p, "malformed "
-					"<dive> date: %s", date);
-				TAILQ_INSERT_TAIL(p->dives, d, entries);
-				return;
-			}
-			tm.tm_year -= 1900;
-			tm.tm_mon -= 1;
-
-			rc = sscanf(time, "%d:%d:%d", 
-				&tm.tm_hour, &tm.tm_min, &tm.tm_sec);
-			if (3 != rc) {
-				logwarnx(p, "malformed "
-					"<dive> time: %s", time);
-				TAILQ_INSERT_TAIL(p->dives, d, entries);
-				return;
-			}
-			tm.tm_isdst = -1;
+		if (NULL != date && NULL != time)
+			d->datetime = parse_datetime(p, date, time);
 
-			/* Convert raw values into epoch. */
+		dive_add(p, d, date);
 
-			if (-1 == (d->datetime = mktime(&tm))) {
-				logwarnx(p, "malformed <dive> "
-					"datetime: %s-%s", date, time);
-				d->datetime = 0;
-				TAILQ_INSERT_TAIL(p->dives, d, entries);
-				return;
+		if (p->caching || p->indexing) {
+			if (d->pid > p->datesz) {
+				p->datesz = 2 * d->pid;
+				p->dates = xreallocarray(p, p->dates,
+					p->datesz, sizeof(char *));
 			}
-
-			/* Check against our global extrema. */
-
-			if (0 == p->stat->timestamp_min ||
-			    d->datetime < p->stat->timestamp_min)
-				p->stat->timestamp_min = d->datetime;
-			if (0 == p->stat->timestamp_max ||
-			    d->datetime > p->stat->timestamp_max)
-				p->stat->timestamp_max = d->datetime;
-		} 
-
-		/*
-		 * Now assign to our group.
-		 * Our group assignment might require data we don't
-		 * have, so we might not be grouping the dive.
-		 */
-
-		if (GROUP_DATE == p->stat->group) {
-			if (NULL == date) {
-				logwarnx(p, "group "
-					"<dive> without date");
-				grp = group_lookup_name(p, d, "");
-			} else
-				grp = group_lookup_name(p, d, date);
-		} else if (GROUP_DIVER == p->stat->group) {
-			if (NULL == d->log->ident) {
-				logwarnx(p, "group "
-					"<dive> without diver");
-				grp = group_lookup_name(p, d, "");
-			} else
-				grp = group_lookup_name(p, 
-					d, d->log->ident);
-		} else if (GROUP_DIVELOG == p->stat->group) {
-			assert(NULL != d->log);
-			grp = group_lookup_divelog(p, d);
-			assert(NULL != grp);
-		} else {
-			if (0 == p->stat->groupsz && verbose)
-				logdbg(p, "new default group");
-			grp = (0 == p->stat->groupsz) ?
-				group_alloc(p, d, NULL) :
-				group_add(p, 0, d);
-		}
-
-		if (NULL != date && 
-		    (0 == grp->mintime || d->datetime < grp->mintime))
-			grp->mintime = d->datetime;
-
-		/* 
-		 * Now register the dive with the dive queue.
-		 * If the dive has a date and time, we order everything
-		 * by time; and furthermore, we order it by offsetting
-		 * from our group's start time.
-		 * If there's no date/time, we just append to the queue.
-		 */
-
-		if (NULL != date && NULL != time) {
-			/* Insert is in reverse order. */
-			TAILQ_FOREACH(dp, p->dives, entries)
-				if (dp->datetime - dp->group->mintime &&
-				    dp->datetime - dp->group->mintime > 
-				    d->datetime - d->group->mintime)
-					break;
-			if (NULL == dp)
-				TAILQ_INSERT_TAIL(p->dives, d, entries);
-			else
-				TAILQ_INSERT_BEFORE(dp, d, entries);
-		} else {
-			/* Un-timedated dive goes wherever. */
-			TAILQ_INSERT_TAIL(p->dives, d, entries);
+			p->dates[d->pid - 1] = NULL == date ? 
+				NULL : xstrdup(p, date);
 		}
-	} else if (0 == strcmp(s, "fingerprint")) {
+	} else if (TOKEN_fingerprint == tok) {
 		if (NULL == (d = p->curdive))
 			logerrx(p, "<fingerprint> not in <dive>");
 		else if (NULL != d->fprint)
@@ -943,19 +1922,19 @@ parse_open(void *dat, const XML_Char *s, const XML_Char **atts)
 			logerrx(p, "nested <fingerprint>");
 		else
 			XML_SetDefaultHandler(p->p, parse_text);
-	} else if (0 == strcmp(s, "gasmix")) {
+	} else if (TOKEN_gasmix == tok) {
 		if (NULL == p->curdive) { 
 			logerrx(p, "<gasmix> not in <dive>");
 			return;
 		}
 		parse_gasmix(p, atts);
-	} else if (0 == strcmp(s, "tank")) {
+	} else if (TOKEN_tank == tok) {
 		if (NULL == p->curdive) { 
 			logerrx(p, "<tank> not in <dive>");
 			return;
 		}
 		parse_tank(p, atts);
-	} else if (0 == strcmp(s, "sample")) {
+	} else if (TOKEN_sample == tok) {
 		if (NULL == (d = p->curdive)) { 
 			logerrx(p, "<sample> not in <dive>");
 			return;
@@ -963,7 +1942,7 @@ parse_open(void *dat, const XML_Char *s, const XML_Char **atts)
 
 		v = NULL;
 		for (ap = atts; NULL != ap[0]; ap += 2)
-			if (0 == strcmp(*ap, "time"))
+			if (TOKEN_time == divecmd_token(*ap))
 				v = ap[1];
 			else
 				logattr(p, "sample", *ap);
@@ -972,19 +1951,31 @@ parse_open(void *dat, const XML_Char *s, const XML_Char **atts)
 			return;
 		}
 
-		i = strtonum(v, 0, LONG_MAX, &er);
+		i = xstrtonum(v, 0, LONG_MAX, &er);
 		if (NULL != er) {
 			logerrx(p, "malformed <sample> time: %s", er);
 			return;
 		}
 
-		p->cursamp = samp = xcalloc(p, 1, sizeof(struct samp));
-		TAILQ_INSERT_TAIL(&d->samps, samp, entries);
+		/* 
+		 * In a summary parse, we only fold the sample into the
+		 * dive; in a compact one, we stage its columns (and maybe
+		 * copy it out) when it's closed.
+		 * Either way, we reuse the same sample each time.
+		 */
+
+		if (p->stat->summary || p->stat->compact) {
+			p->cursamp = samp = &p->scratch;
+			memset(samp, 0, sizeof(struct samp));
+		} else {
+			p->cursamp = samp = 
+				xarena_calloc(p, d, 1, sizeof(struct samp));
+			TAILQ_INSERT_TAIL(&d->samps, samp, entries);
+		}
 		d->nsamps++;
 
 		samp->time = i;
-		samp->line = XML_GetCurrentLineNumber(p->p);
-		samp->col = XML_GetCurrentColumnNumber(p->p);
+		parse_pos(p, &samp->line, &samp->col);
 
 		if (samp->time > d->maxtime)
 			d->maxtime = samp->time;
@@ -997,7 +1988,7 @@ parse_open(void *dat, const XML_Char *s, const XML_Char **atts)
 
 		logdbg(p, "new sample: num=%zu, time=%zu",
 			d->num, samp->time);
-	} else if (0 == strcmp(s, "vendor")) {
+	} else if (TOKEN_vendor == tok) {
 		if (NULL == (samp = p->cursamp)) {
 			logerrx(p, "<vendor> not in <sample>");
 			return;
@@ -1007,7 +1998,7 @@ parse_open(void *dat, const XML_Char *s, const XML_Char **atts)
 		}
 		v = NULL;
 		for (ap = atts; NULL != ap[0]; ap += 2)
-			if (0 == strcmp(*ap, "type"))
+			if (TOKEN_type == divecmd_token(*ap))
 				v = ap[1];
 			else
 				logattr(p, "vendor", *ap);
@@ -1015,14 +2006,17 @@ parse_open(void *dat, const XML_Char *s, const XML_Char **atts)
 			lognattr(p, "vendor", "type");
 			return;
 		}
-		samp->vendor.type = strtonum(v, 0, LONG_MAX, &er);
+		samp->vendor.type = xstrtonum(v, 0, LONG_MAX, &er);
 		if (NULL != er) {
 			logerrx(p, "malformed <vendor> type: %s", v);
 			return;
 		}
-		XML_SetDefaultHandler(p->p, parse_text);
+		if ( ! p->stat->summary && (SAMP_VENDOR & p->stat->want))
+			XML_SetDefaultHandler(p->p, parse_vendor_text);
+		p->nibble = 0;
+		p->vendorbad = 0;
 		samp->flags |= SAMP_VENDOR;
-	} else if (0 == strcmp(s, "depth")) {
+	} else if (TOKEN_depth == tok) {
 		if (NULL == (samp = p->cursamp))
 			return;
 		if (SAMP_DEPTH & samp->flags) {
@@ -1032,7 +2026,7 @@ parse_open(void *dat, const XML_Char *s, const XML_Char **atts)
 
 		v = NULL;
 		for (ap = atts; NULL != ap[0]; ap += 2)
-			if (0 == strcmp(*ap, "value"))
+			if (TOKEN_value == divecmd_token(*ap))
 				v = ap[1];
 			else
 				logattr(p, "depth", *ap);
@@ -1041,19 +2035,21 @@ parse_open(void *dat, const XML_Char *s, const XML_Char **atts)
 			return;
 		}
 
-		if ( ! xstrtod(v, &samp->depth)) {
+		if ( ! xstrtod(v, &dv)) {
 			logerrx(p, "malformed <depth> value: %s", v);
 			return;
 		}
+		samp->flags |= SAMP_DEPTH;
+		if ( ! (SAMP_DEPTH & p->stat->want))
+			return;
 
+		samp->depth = dv;
 		if (samp->depth > p->curdive->maxdepth)
 			p->curdive->maxdepth = samp->depth;
-		samp->flags |= SAMP_DEPTH;
-	} else if (0 == strcmp(s, "pressure")) {
-		if (NULL == p->cursamp)
-			return;
-		parse_pressure(p, atts);
-	} else if (0 == strcmp(s, "rbt")) {
+	} else if (TOKEN_pressure == tok) {
+		if (NULL != p->cursamp)
+			parse_pressure(p, atts);
+	} else if (TOKEN_rbt == tok) {
 		if (NULL == (samp = p->cursamp)) {
 			logerrx(p, "<rbt> not in <sample>");
 			return;
@@ -1064,7 +2060,7 @@ parse_open(void *dat, const XML_Char *s, const XML_Char **atts)
 
 		v = NULL;
 		for (ap = atts; NULL != ap[0]; ap += 2)
-			if (0 == strcmp(*ap, "value"))
+			if (TOKEN_value == divecmd_token(*ap))
 				v = ap[1];
 			else
 				logattr(p, "rbt", *ap);
@@ -1073,19 +2069,19 @@ parse_open(void *dat, const XML_Char *s, const XML_Char **atts)
 			return;
 		}
 
-		samp->rbt = strtonum(v, 0, LONG_MAX, &er);
+		samp->rbt = xstrtonum(v, 0, LONG_MAX, &er);
 		if (NULL != er) {
 			logerrx(p, "malformed <rbt> value: %s", v);
 			return;
 		}
 		samp->flags |= SAMP_RBT;
-	} else if (0 == strcmp(s, "event")) {
+	} else if (TOKEN_event == tok) {
 		if (NULL == p->cursamp) {
 			logerrx(p, "<event> not in <sample>");
 			return;
 		} else
 			parse_event(p, atts);
-	} else if (0 == strcmp(s, "deco")) {
+	} else if (TOKEN_deco == tok) {
 		/* Ignore deco when freediving. */
 		if (NULL == (samp = p->cursamp))
 			logerrx(p, "<deco> not in <sample>");
@@ -1093,7 +2089,7 @@ parse_open(void *dat, const XML_Char *s, const XML_Char **atts)
 			logerrx(p, "restatement of <deco>");
 		else if (MODE_FREEDIVE != p->curdive->mode)
 			parse_deco(p, atts);
-	} else if (0 == strcmp(s, "temp")) {
+	} else if (TOKEN_temp == tok) {
 		if (NULL == (samp = p->cursamp)) {
 			logerrx(p, "<temp> not in <sample>");
 			return;
@@ -1104,7 +2100,7 @@ parse_open(void *dat, const XML_Char *s, const XML_Char **atts)
 
 		v = NULL;
 		for (ap = atts; NULL != ap[0]; ap += 2)
-			if (0 == strcmp(*ap, "value"))
+			if (TOKEN_value == divecmd_token(*ap))
 				v = ap[1];
 			else
 				logattr(p, "temp", *ap);
@@ -1113,11 +2109,17 @@ parse_open(void *dat, const XML_Char *s, const XML_Char **atts)
 			return;
 		}
 
-		if ( ! xstrtod(v, &samp->temp)) {
+		if ( ! xstrtod(v, &dv)) {
 			logerrx(p, "malformed <temp> value: %s", v);
 			return;
 		}
+		samp->flags |= SAMP_TEMP;
+		if ( ! (SAMP_TEMP & p->stat->want))
+			return;
 
+		samp->temp = dv;
+		p->curdive->sumtemp += samp->temp;
+		p->curdive->ntemps++;
 		if (0 == p->curdive->hastemp) {
 			p->curdive->maxtemp = samp->temp;
 			p->curdive->mintemp = samp->temp;
@@ -1128,8 +2130,7 @@ parse_open(void *dat, const XML_Char *s, const XML_Char **atts)
 			if (samp->temp < p->curdive->mintemp)
 				p->curdive->mintemp = samp->temp;
 		}
-		samp->flags |= SAMP_TEMP;
-	} else if (0 == strcmp(s, "cns")) {
+	} else if (TOKEN_cns == tok) {
 		if (NULL == (samp = p->cursamp)) {
 			logerrx(p, "<cns> not in <sample>");
 			return;
@@ -1139,7 +2140,7 @@ parse_open(void *dat, const XML_Char *s, const XML_Char **atts)
 		}
 
 		for (v = NULL, ap = atts; NULL != ap[0]; ap += 2)
-			if (0 == strcmp(*ap, "value"))
+			if (TOKEN_value == divecmd_token(*ap))
 				v = ap[1];
 			else
 				logattr(p, "cns", *ap);
@@ -1147,12 +2148,14 @@ parse_open(void *dat, const XML_Char *s, const XML_Char **atts)
 		if (NULL == v) {
 			lognattr(p, "cns", "value");
 			return;
-		} else if ( ! xstrtod(v, &samp->cns)) {
+		} else if ( ! xstrtod(v, &dv)) {
 			logerrx(p, "malformed <cns> value: %s", v);
 			return;
 		}
 		samp->flags |= SAMP_CNS;
-	} else if (0 == strcmp(s, "gaschange")) {
+		if (SAMP_CNS & p->stat->want)
+			samp->cns = dv;
+	} else if (TOKEN_gaschange == tok) {
 		if (NULL == (samp = p->cursamp)) {
 			logerrx(p, "<gaschange> not in <sample>");
 			return;
@@ -1163,7 +2166,7 @@ parse_open(void *dat, const XML_Char *s, const XML_Char **atts)
 
 		v = NULL;
 		for (ap = atts; NULL != ap[0]; ap += 2)
-			if (0 == strcmp(*ap, "mix"))
+			if (TOKEN_mix == divecmd_token(*ap))
 				v = ap[1];
 			else
 				logattr(p, "gaschange", *ap);
@@ -1172,37 +2175,35 @@ parse_open(void *dat, const XML_Char *s, const XML_Char **atts)
 			return;
 		}
 
-		samp->gaschange = strtonum(v, 0, UINT_MAX, &er) + 1;
+		samp->gaschange = xstrtonum(v, 0, UINT_MAX, &er) + 1;
 		if (NULL != er) {
 			logerrx(p, "bad <gaschange> mix: %s", er);
 			return;
 		}
-		for (i = 0; i < p->curdive->gassz; i++)
-			if (samp->gaschange == p->curdive->gas[i].num)
-				break;
-		if (i == p->curdive->gassz) {
+		if ( ! gas_exists(p->curdive, 
+		    &p->gasnums, samp->gaschange)) {
 			logerrx(p, "unknown <gaschange> mix: %s", v);
 			return;
 		}
 		samp->flags |= SAMP_GASCHANGE;
-	} else if (0 == strcmp(s, "dives")) {
+	} else if (TOKEN_dives == tok) {
 		if (NULL == p->curlog)
 			logerrx(p, "<dives> not in <divelog>");
-	} else if (0 == strcmp(s, "gasmixes")) {
+	} else if (TOKEN_gasmixes == tok) {
 		if (NULL == p->curdive)
 			logerrx(p, "<gasmixes> not in <dive>");
 		else if (NULL != p->cursamp)
 			logerrx(p, "<gasmixes> in <sample>");
 		else if (p->curdive->gassz) 
 			logerrx(p, "restatement of <gasmixes>");
-	} else if (0 == strcmp(s, "tanks")) {
+	} else if (TOKEN_tanks == tok) {
 		if (NULL == p->curdive)
 			logerrx(p, "<tanks> not in <dive>");
 		else if (NULL != p->cursamp)
 			logerrx(p, "<tanks> in <sample>");
 		else if (p->curdive->cylsz) 
 			logerrx(p, "restatement of <tanks>");
-	} else if (0 == strcmp(s, "samples")) {
+	} else if (TOKEN_samples == tok) {
 		if (NULL == p->curdive)
 			logerrx(p, "<samples> not in <dive>");
 		else if (NULL != p->cursamp)
@@ -1217,12 +2218,163 @@ parse_open(void *dat, const XML_Char *s, const XML_Char **atts)
 	}
 }
 
+/*
+ * Allocate the columnar view of a dive's samples.
+ * All columns are carved from a single allocation in the dive's arena.
+ * Summary parses keep no samples, so have no columns.
+ */
+static void
+dive_cols_alloc(struct parse *p, struct dive *d)
+{
+	struct sampcols	*c = &d->cols;
+	double		*v;
+
+	if (p->stat->summary || 0 == (c->sz = d->nsamps))
+		return;
+
+	/* Lay out doubles first so everything is aligned. */
+
+	v = xarena_calloc(p, d, c->sz, 3 * sizeof(double) +
+		sizeof(size_t) + sizeof(unsigned char));
+	c->depth = v;
+	c->temp = v + c->sz;
+	c->cns = v + 2 * c->sz;
+	c->time = (size_t *)(v + 3 * c->sz);
+	c->flags = (unsigned char *)(c->time + c->sz);
+}
+
+/*
+ * In a compact parse, stage the columns of the just-closed sample "s"
+ * of "d".
+ * If it has fields that aren't in the columns, it's also copied into
+ * the dive's samples and marked as such with SAMP_EXTRA.
+ */
+static void
+samp_stage(struct parse *p, struct dive *d, const struct samp *s)
+{
+	struct csamp	*cs;
+	struct samp	*samp;
+	size_t		 max;
+
+	if (p->stagesz == p->stagemax) {
+		max = p->stagemax ? p->stagemax * 2 : 1024;
+		cs = reallocarray(p->stage, max, sizeof(struct csamp));
+		if (NULL == cs)
+			logfatal(p, "reallocarray");
+		p->stage = cs;
+		p->stagemax = max;
+	}
+
+	cs = &p->stage[p->stagesz++];
+	cs->time = s->time;
+	cs->depth = s->depth;
+	cs->temp = s->temp;
+	cs->cns = s->cns;
+	cs->flags = s->flags;
+
+	if ((SAMP_RARE & s->flags) || s->pressuresz || s->eventsz) {
+		samp = xarena_calloc(p, d, 1, sizeof(struct samp));
+		*samp = *s;
+		TAILQ_INSERT_TAIL(&d->samps, samp, entries);
+		cs->flags |= SAMP_EXTRA;
+	}
+}
+
+/*
+ * Fill in the columnar view of a dive's samples.
+ */
+static void
+dive_cols(struct parse *p, struct dive *d)
+{
+	struct sampcols	*c = &d->cols;
+	struct samp	*s;
+	size_t		 i = 0;
+
+	dive_cols_alloc(p, d);
+
+	if (p->stat->compact) {
+		assert(0 == c->sz || p->stagesz == c->sz);
+		for (i = 0; i < c->sz; i++) {
+			c->time[i] = p->stage[i].time;
+			c->depth[i] = p->stage[i].depth;
+			c->temp[i] = p->stage[i].temp;
+			c->cns[i] = p->stage[i].cns;
+			c->flags[i] = p->stage[i].flags;
+		}
+		p->stagesz = 0;
+		return;
+	}
+
+	TAILQ_FOREACH(s, &d->samps, entries) {
+		assert(i < c->sz);
+		c->time[i] = s->time;
+		c->depth[i] = s->depth;
+		c->temp[i] = s->temp;
+		c->cns[i] = s->cns;
+		c->flags[i] = s->flags;
+		i++;
+	}
+	assert(i == c->sz);
+}
+
+static int link_dive(struct dive *);
+
+static void
+dive_free(struct dive *d)
+{
+
+	arena_free(d);
+	free(d->gas);
+	free(d->cyls);
+	free(d->fprint);
+	free(d);
+}
+
+/*
+ * Pass a closed dive to the streaming callback, first doing what
+ * link_dives() and merge_file() would otherwise do after the parse.
+ * The dive is freed unless the callback keeps it; and if the callback
+ * asks us to stop, the parse is aborted.
+ */
+static void
+dive_emit(struct parse *p, struct dive *d)
+{
+	struct dgroup	*dg = d->group;
+	int		 c;
+
+	if ( ! link_dive(d))
+		p->linkerrs++;
+	if (d->datetime &&
+	    (0 == dg->mintime || d->datetime < dg->mintime))
+		dg->mintime = d->datetime;
+	group_key(p, d);
+
+	if ((c = p->cb(d, p->arg)) > 0)
+		return;
+
+	TAILQ_REMOVE(p->dives, d, entries);
+	TAILQ_REMOVE(&dg->dives, d, gentries);
+	dg->ndives--;
+	dive_free(d);
+
+	if (c < 0) {
+		p->stopped = 1;
+		XML_StopParser(p->p, XML_FALSE);
+	}
+}
+
 static void
 parse_close(void *dat, const XML_Char *s)
 {
 	struct parse	*p = dat;
+	struct irange	*r;
+	struct samp	*samp;
+	uint64_t	 end;
+	enum token	 tok = divecmd_token(s);
 
-	if (0 == strcmp(s, "fingerprint")) {
+	p->depth--;
+
+	if (TOKEN_fingerprint == tok) {
 		/*
 		 * Set the fingerprint.
 		 * An empty element unsets the fingerprint.
@@ -1230,34 +2382,55 @@ parse_close(void *dat, const XML_Char *s)
 		 */
 
 		XML_SetDefaultHandler(p->p, NULL);
-		if (NULL != p->curdive && p->bufsz) {
-			free(p->curdive->fprint);
-			p->curdive->fprint = 
-				xstrndup(p, p->buf, p->bufsz);
-		} else if (NULL != p->curdive && 0 == p->bufsz) {
-			free(p->curdive->fprint);
-			p->curdive->fprint = NULL;
-		} else
+		if (NULL != p->curdive && p->bufsz)
+			dive_fprint(p, p->curdive, p->buf, p->bufsz);
+		else if (NULL != p->curdive && 0 == p->bufsz)
+			dive_fprint(p, p->curdive, NULL, 0);
+		else
 			logwarnx(p, "fingerprint not in dive context");
-		free(p->buf);
-		p->buf = NULL;
 		p->bufsz = 0;
-	} else if (0 == strcmp(s, "divelog")) {
+	} else if (TOKEN_divelog == tok) {
+		while (NULL != p->feed && 
+		    p->feed->next < p->feed->divesz)
+			dive_stub(p);
 		p->curlog = NULL;
-	} else if (0 == strcmp(s, "dive")) {
-		group_readd(p, p->curdive);
+		p->loggroup = NULL;
+	} else if (TOKEN_dive == tok) {
+		if (p->indexing) {
+			/* Empty elements have no end tag. */
+			r = &p->ranges[p->curdive->pid - 1];
+			end = XML_GetCurrentByteIndex(p->p) +
+				XML_GetCurrentByteCount(p->p);
+			if (end > r->off + r->len)
+				r->len = end - r->off;
+		}
+		dive_cols(p, p->curdive);
+		if (NULL != p->cb)
+			dive_emit(p, p->curdive);
+		else
+			group_key(p, p->curdive);
 		p->curdive = NULL;
-	} else if (0 == strcmp(s, "sample")) {
+	} else if (TOKEN_sample == tok) {
+		/* Unwanted fields were checked, but aren't kept. */
+		if (NULL != p->cursamp)
+			p->cursamp->flags &= p->stat->want;
+		if (NULL != p->cursamp && 
+		    p->stat->compact && ! p->stat->summary)
+			samp_stage(p, p->curdive, p->cursamp);
 		p->cursamp = NULL;
-	} else if (0 == strcmp(s, "vendor")) {
+	} else if (TOKEN_vendor == tok) {
 		XML_SetDefaultHandler(p->p, NULL);
-		if (NULL != p->cursamp) {
-			free(p->cursamp->vendor.buf);
-			p->cursamp->vendor.buf = 
-				xstrndup(p, p->buf, p->bufsz);
+		if (NULL != p->cursamp && ! p->stat->summary &&
+		    (SAMP_VENDOR & p->stat->want)) {
+			samp = p->cursamp;
+			if ( ! p->vendorbad && p->nibble)
+				logwarnx(p, "malformed "
+					"<vendor> data: ignoring");
+			else if ( ! p->vendorbad &&
+			    (samp->vendor.bufsz = p->bufsz) > 0)
+				samp->vendor.buf = xarena_memdup
+					(p, p->curdive, p->buf, p->bufsz);
 		}
-		free(p->buf);
-		p->buf = NULL;
 		p->bufsz = 0;
 	}
 
@@ -1275,122 +2448,1921 @@ static int
 link_dive(struct dive *d)
 {
 	struct samp	*s;
-	size_t		 i, j, errs = 0;
+	struct numset	 gases, cyls;
+	size_t		 i, j, tank, errs = 0, 
+			*add = NULL, addsz = 0, addmax = 0;
+
+	memset(&gases, 0, sizeof(struct numset));
+	memset(&cyls, 0, sizeof(struct numset));
+	for (i = 0; i < d->gassz; i++)
+		numset_add(&gases, d->gas[i].num);
+	for (i = 0; i < d->cylsz; i++)
+		numset_add(&cyls, d->cyls[i].num);
+
+	/* 
+	 * Tanks with pressures but no <tank> are created, in order, all
+	 * at once after the samples have been checked.
+	 */
 
 	TAILQ_FOREACH(s, &d->samps, entries) {
-		if (SAMP_GASCHANGE & s->flags) {
-			for (i = 0; i < d->gassz; i++)
-				if (s->gaschange == d->gas[i].num)
-					break;
-			if (i == d->gassz) {
-				warnx("unknown gas: %zu", 
-					s->gaschange);
-				errs++;
-			}
+		if ((SAMP_GASCHANGE & s->flags) &&
+		    ! gas_exists(d, &gases, s->gaschange)) {
+			warnx("unknown gas: %zu", s->gaschange);
+			errs++;
 		}
 		for (i = 0; i < s->pressuresz; i++) {
-			for (j = 0; j < d->cylsz; j++) 
-				if (s->pressure[i].tank == 
-				    d->cyls[j].num)
-					break;
-			if (j == d->cylsz) {
-				d->cyls = reallocarray
-					(d->cyls, d->cylsz + 1,
-					 sizeof(struct cylinder));
-				if (NULL == d->cyls)
+			tank = s->pressure[i].tank;
+			if (cyl_exists(d, &cyls, tank))
+				continue;
+			if (tank >= NUMSET_MAX) {
+				for (j = 0; j < addsz; j++)
+					if (tank == add[j])
+						break;
+				if (j < addsz)
+					continue;
+			}
+			if (addsz == addmax) {
+				addmax = 0 == addmax ? 8 : addmax * 2;
+				add = reallocarray(add, 
+					addmax, sizeof(size_t));
+				if (NULL == add)
 					err(EXIT_FAILURE, NULL);
-				memset(&d->cyls[d->cylsz], 0,
-					sizeof(struct cylinder));
-				d->cyls[d->cylsz++].num = 
-					s->pressure[i].tank;
 			}
+			add[addsz++] = tank;
+			numset_add(&cyls, tank);
 		}
 	}
 
-	for (i = 0; i < d->cylsz; i++) {
-		if (0 == d->cyls[i].mix)
-			continue;
-		for (j = 0; j < d->gassz; j++)
-			if (d->cyls[i].mix == d->gas[j].num)
-				break;
-		if (j == d->gassz) {
+	if (addsz > 0) {
+		d->cyls = reallocarray(d->cyls, 
+			d->cylsz + addsz, sizeof(struct cylinder));
+		if (NULL == d->cyls)
+			err(EXIT_FAILURE, NULL);
+		memset(&d->cyls[d->cylsz], 0, 
+			addsz * sizeof(struct cylinder));
+		for (i = 0; i < addsz; i++)
+			d->cyls[d->cylsz++].num = add[i];
+		free(add);
+	}
+
+	for (i = 0; i < d->cylsz; i++)
+		if (0 != d->cyls[i].mix &&
+		    ! gas_exists(d, &gases, d->cyls[i].mix)) {
 			warnx("unknown gas: %zu", d->cyls[i].mix);
 			errs++;
 		}
-	}
 
 	return 0 == errs;
 }
 
 static int
-link_dives(struct diveq *dq)
+dsort_cmp(const void *a, const void *b)
 {
-	size_t	 	 errs = 0;
-	struct dive	*d;
+	const struct dsort *x = a, *y = b;
 
-	TAILQ_FOREACH(d, dq, entries)
-		if ( ! link_dive(d))
-			errs++;
+	if (x->dated != y->dated)
+		return x->dated ? -1 : 1;
+	if (x->dated && x->key != y->key)
+		return x->key < y->key ? -1 : 1;
+	return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
 
-	return 0 == errs;
+static int
+dsort_gkey_cmp(const void *a, const void *b)
+{
+	const struct dsort *x = a, *y = b;
+
+	if (x->gkey != y->gkey)
+		return x->gkey < y->gkey ? -1 : 1;
+	return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+static int
+dsort_rgkey_cmp(const void *a, const void *b)
+{
+	const struct dsort *x = a, *y = b;
+
+	if (x->gkey != y->gkey)
+		return x->gkey > y->gkey ? -1 : 1;
+	return x->seq < y->seq ? -1 : x->seq > y->seq;
 }
 
 /*
- * Parse a set of dives, accumulating the dives into "dq" and into the
- * group dives.
- * Dives in "dq" are ordered, by default, by date.
- * If a split is specified, however, they're ordered by relative date
- * from the first dive of the given group.
- * So for example, if you have GROUP_DATE and two days, the dives will
- * be ordered by the relative from the beginning of each day's first
- * dive.
- * This lets them be interleaved nicely.
+ * Stably order a queue of dives.
+ * If "dg" is not NULL, this orders the group's queue by "gs": by date
+ * and time, with undated dives at the end, or by the key from
+ * group_key().
+ * Otherwise, "dq" is ordered by time relative to each dive's group,
+ * again with undated dives at the end.
+ * The array "ds" must be able to hold all dives in the queue.
+ * This does nothing if the queue is already in order.
  */
-int
-divecmd_parse(const char *fname, XML_Parser p, 
-	struct diveq *dq, struct divestat *st)
+static void
+dives_sort(struct diveq *dq, struct dgroup *dg, 
+	enum groupsort gs, struct dsort *ds)
 {
-	int	 	 fd;
-	struct parse	 pp;
-	ssize_t		 ssz;
-	char		 buf[BUFSIZ];
-	enum XML_Status	 rc;
+	struct dive	*d;
+	size_t		 i, n = 0, sorted = 1;
+	int		(*cmp)(const void *, const void *) = dsort_cmp;
 
-	fd = strcmp("-", fname) ? 
-		open(fname, O_RDONLY, 0) : STDIN_FILENO;
-	if (-1 == fd) {
-		warn("%s", fname);
-		return(0);
+	if (NULL != dg && GROUPSORT_DATETIME != gs) {
+		if (GROUPSORT_RMAXTIME == gs || 
+		    GROUPSORT_RMAXDEPTH == gs)
+			cmp = dsort_rgkey_cmp;
+		else
+			cmp = dsort_gkey_cmp;
+		TAILQ_FOREACH(d, &dg->dives, gentries) {
+			ds[n].d = d;
+			ds[n].gkey = d->gkey;
+			ds[n].seq = n;
+			n++;
+		}
+	} else if (NULL != dg) {
+		TAILQ_FOREACH(d, &dg->dives, gentries) {
+			ds[n].d = d;
+			ds[n].dated = 0 != d->datetime;
+			ds[n].key = d->datetime;
+			ds[n].seq = n;
+			n++;
+		}
+	} else {
+		TAILQ_FOREACH(d, dq, entries) {
+			ds[n].d = d;
+			ds[n].dated = 0 != d->datetime;
+			ds[n].key = ds[n].dated ?
+				d->datetime - d->group->mintime : 0;
+			ds[n].seq = n;
+			n++;
+		}
 	}
 
-	memset(&pp, 0, sizeof(struct parse));
+	for (i = 1; i < n && sorted; i++)
+		sorted = cmp(&ds[i - 1], &ds[i]) < 0;
+	if (sorted)
+		return;
 
-	pp.file = STDIN_FILENO == fd ? "<stdin>" : fname;
-	pp.p = p;
-	pp.dives = dq;
-	pp.stat = st;
+	qsort(ds, n, sizeof(struct dsort), cmp);
+
+	if (NULL != dg) {
+		TAILQ_INIT(&dg->dives);
+		for (i = 0; i < n; i++)
+			TAILQ_INSERT_TAIL(&dg->dives, ds[i].d, gentries);
+	} else {
+		TAILQ_INIT(dq);
+		for (i = 0; i < n; i++)
+			TAILQ_INSERT_TAIL(dq, ds[i].d, entries);
+	}
+}
+
+/*
+ * Order the dive queue and each group.
+ * Dives are appended as they're parsed, so this is run once per file.
+ */
+static void
+dives_sort_all(struct diveq *dq, struct divestat *st)
+{
+	struct dive	*d;
+	struct dsort	*ds;
+	size_t		 i, n = 0;
+
+	TAILQ_FOREACH(d, dq, entries)
+		n++;
+	if (n < 2)
+		return;
+	if (NULL == (ds = reallocarray(NULL, n, sizeof(struct dsort))))
+		err(EXIT_FAILURE, NULL);
+
+	dives_sort(dq, NULL, st->groupsort, ds);
+	for (i = 0; i < st->groupsz; i++)
+		dives_sort(NULL, st->groups[i], st->groupsort, ds);
+
+	free(ds);
+}
+
+static int
+link_dives(struct diveq *dq)
+{
+	size_t	 	 errs = 0;
+	struct dive	*d;
+
+	TAILQ_FOREACH(d, dq, entries)
+		if ( ! link_dive(d))
+			errs++;
+
+	return 0 == errs;
+}
+
+/*
+ * Pass "len" bytes at "off" of the mapped "map" to "p" in chunks.
+ * Returns non-zero on success, zero on a parse error.
+ */
+static int
+feed_range(XML_Parser p, const char *map, uint64_t off, uint64_t len)
+{
+	size_t	 sz;
+
+	for ( ; len > 0; off += sz, len -= sz) {
+		sz = len > FEED_CHUNK ? FEED_CHUNK : len;
+		if (XML_STATUS_OK != XML_Parse(p, map + off, (int)sz, 0))
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * Like divecmd_feed(), but passing only the parts of "fd" (named
+ * "fname") chosen from its index in "f".
+ */
+static int
+feed_index(XML_Parser p, int fd, const char *fname, const struct ifeed *f)
+{
+	struct stat	 st;
+	char		*map;
+	size_t		 i;
+	int		 rc;
+
+	if (-1 == fstat(fd, &st)) {
+		warn("%s", fname);
+		return -1;
+	} else if ((uint64_t)st.st_size != f->size) {
+		warnx("%s: changed while parsing", fname);
+		return -1;
+	} else if (0 == f->size)
+		return 1;
+
+	map = mmap(NULL, f->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (MAP_FAILED == map) {
+		warn("%s", fname);
+		return -1;
+	}
+
+	rc = feed_range(p, map, 0, f->head);
+	for (i = 0; i < f->divesz && rc; i++)
+		if (f->chosen[i])
+			rc = feed_range(p, map, 
+				f->dives[i].off, f->dives[i].len);
+	if (rc)
+		rc = feed_range(p, map, f->tail, f->size - f->tail);
+
+	munmap(map, f->size);
+	return rc;
+}
+
+/*
+ * Parse a single file into the dive queue and statistics of "pp",
+ * which must otherwise be zeroed.
+ * Unless there's a streaming callback, dives are left in parse order
+ * and unlinked.
+ * This is safe to run concurrently on different files as long as each
+ * has its own parser "p" and "pp".
+ * Returns zero on failure, non-zero on success.
+ */
+static int
+parse_file(XML_Parser p, struct parse *pp, const char *fname)
+{
+	int	 	 fd, rc;
+
+	fd = strcmp("-", fname) ? 
+		open(fname, O_RDONLY, 0) : STDIN_FILENO;
+	if (-1 == fd) {
+		warn("%s", fname);
+		return(0);
+	}
+
+	pp->file = STDIN_FILENO == fd ? "<stdin>" : fname;
+	pp->p = p;
 
 	XML_ParserReset(p, NULL);
 	XML_SetElementHandler(p, parse_open, parse_close);
-	XML_SetUserData(p, &pp);
+	XML_SetUserData(p, pp);
+
+	rc = NULL != pp->feed ? 
+		feed_index(p, fd, fname, pp->feed) :
+		divecmd_feed(p, fd, fname);
+	if (0 == rc && ! pp->stopped)
+		logerrp(pp);
 
-	while ((ssz = read(fd, buf, sizeof(buf))) > 0) {
-	       rc = XML_Parse(p, buf, (int)ssz, 0 == ssz ? 1 : 0);
-	       if (XML_STATUS_OK != rc) {
-		       logerrp(&pp);
-		       break;
-	       } else if (0 == ssz)
-		       break;
+	if (rc >= 0 && NULL == pp->cb && ! link_dives(pp->dives))
+		rc = 0;
+	if (pp->linkerrs)
+		rc = 0;
+
+	close(fd);
+	free(pp->buf);
+	pp->buf = NULL;
+	pp->bufsz = pp->bufmax = 0;
+	free(pp->stage);
+	pp->stage = NULL;
+	pp->stagesz = pp->stagemax = 0;
+	return rc > 0;
+}
+
+/*
+ * A growable output buffer for cache_write().
+ */
+struct	cbuf {
+	char		*buf;
+	size_t		 sz; /* bytes used */
+	size_t		 max; /* bytes allocated */
+};
+
+/*
+ * Append "sz" bytes from "p" to "b".
+ * Returns zero on memory exhaustion, non-zero on success.
+ */
+static int
+cbuf_add(struct cbuf *b, const void *p, size_t sz)
+{
+	size_t	 max;
+	void	*pp;
+
+	if (b->sz + sz > b->max) {
+		max = b->max ? b->max : 4096;
+		while (max < b->sz + sz)
+			max *= 2;
+		if (NULL == (pp = realloc(b->buf, max)))
+			return 0;
+		b->buf = pp;
+		b->max = max;
 	}
+	memcpy(b->buf + b->sz, p, sz);
+	b->sz += sz;
+	return 1;
+}
 
-	if (ssz < 0)
-		warn("%s", fname);
-	else if ( ! link_dives(dq))
-		ssz = -1;
+/*
+ * Add "sz" bytes from "cp", then a nil, to the string table "b".
+ * Returns the cache reference: zero for a NULL "cp", else one plus its
+ * offset.
+ * On memory exhaustion, sets "ok" to zero.
+ */
+static uint32_t
+cbuf_mem(struct cbuf *b, const void *cp, size_t sz, int *ok)
+{
+	size_t	 off = b->sz;
+
+	if (NULL == cp)
+		return 0;
+	if (off >= UINT32_MAX || 
+	    ! cbuf_add(b, cp, sz) || ! cbuf_add(b, "", 1))
+		*ok = 0;
+	return (uint32_t)(off + 1);
+}
+
+/*
+ * Add a nil-terminated string to the string table "b".
+ * See cbuf_mem().
+ */
+static uint32_t
+cbuf_str(struct cbuf *b, const char *cp, int *ok)
+{
+
+	return cbuf_mem(b, cp, NULL == cp ? 0 : strlen(cp), ok);
+}
 
+/*
+ * Write the header "hdr" of "hsz" bytes followed by the "bsz" buffers
+ * "b" into a new temporary file made from the template "tmp", then
+ * rename it to "path".
+ * Failures are reported, but aren't fatal: the temporary file is
+ * always closed and, on failure, removed.
+ */
+static void
+cbuf_commit(char *tmp, const char *path, 
+	const void *hdr, size_t hsz, const struct cbuf *b, size_t bsz)
+{
+	size_t	 i;
+	int	 fd, ok;
+
+	if (-1 == (fd = mkstemp(tmp))) {
+		warn("%s", tmp);
+		return;
+	}
+
+	ok = (ssize_t)hsz == write(fd, hdr, hsz);
+	for (i = 0; ok && i < bsz; i++)
+		ok = 0 == b[i].sz || 
+			(ssize_t)b[i].sz == write(fd, b[i].buf, b[i].sz);
+
+	if (-1 == close(fd))
+		ok = 0;
+	if ( ! ok || -1 == rename(tmp, path)) {
+		warn("%s", tmp);
+		(void)unlink(tmp);
+	}
+}
+
+/*
+ * Look up a cached string reference "ref" in a table of "sz" bytes.
+ * The table must be nil-terminated.
+ * Returns NULL if the reference is zero or out of range.
+ */
+static const char *
+cache_str(const char *tab, uint64_t sz, uint32_t ref)
+{
+
+	if (0 == ref || ref > sz)
+		return NULL;
+	return tab + ref - 1;
+}
+
+/*
+ * Where to cache the file with status "sb" in the directory "dir".
+ * Returns zero if the name doesn't fit in "buf" of size "sz".
+ */
+static int
+cache_path(char *buf, size_t sz, const char *dir, const struct stat *sb)
+{
+	int	 c;
+
+	c = snprintf(buf, sz, "%s/%jx-%jx.dcache", dir, 
+		(uintmax_t)sb->st_dev, (uintmax_t)sb->st_ino);
+	return c > 0 && (size_t)c < sz;
+}
+
+/*
+ * Serialise the parsed contents of "pf" (in parse order, with the
+ * <dive> dates in "pp") into "dir", to be used in place of the file
+ * with status "sb" until it changes.
+ * The cache is written to a temporary file then renamed into place.
+ * Failures are reported, but aren't fatal.
+ */
+static void
+cache_write(const struct pfile *pf, const struct parse *pp,
+	const char *dir, const struct stat *sb)
+{
+	struct cbuf	 	 b[CSECT__MAX];
+	struct cachehdr		 hdr;
+	struct cachelog		 cl;
+	struct cachedive	 cd;
+	struct cachesamp	 cs;
+	struct cachepres	 cp;
+	struct cacheevent	 ce;
+	struct cachegas		 cg;
+	struct cachecyl		 cc;
+	const struct dlog	*dl, **logs = NULL;
+	const struct dive	*d;
+	const struct sampcols	*c;
+	const struct samp	*s, *next;
+	size_t			 i, j, k, logsz = 0;
+	uint64_t		 v;
+	char			 path[PATH_MAX], tmp[PATH_MAX];
+	int			 ok = 1;
+
+	if ( ! cache_path(path, sizeof(path), dir, sb) ||
+	    (size_t)snprintf(tmp, sizeof(tmp), 
+	     "%s.XXXXXXXXXX", path) >= sizeof(tmp)) {
+		warnx("%s: cache path too long", dir);
+		return;
+	}
+
+	memset(b, 0, sizeof(b));
+	memset(&hdr, 0, sizeof(struct cachehdr));
+	memcpy(hdr.magic, CACHE_MAGIC, sizeof(hdr.magic));
+	hdr.version = CACHE_VERSION;
+	hdr.endian = CACHE_ENDIAN;
+	hdr.dev = sb->st_dev;
+	hdr.ino = sb->st_ino;
+	hdr.size = sb->st_size;
+	hdr.mtime = sb->st_mtim.tv_sec;
+	hdr.mtimens = sb->st_mtim.tv_nsec;
+	hdr.want = pf->stat.want;
+	if ( ! pf->stat.compact)
+		hdr.want |= CACHE_POSITIONS;
+
+	/* Start the string table with an empty string. */
+
+	ok = cbuf_add(&b[CSECT_STRS], "", 1);
+
+	TAILQ_FOREACH(dl, &pf->stat.dlogs, entries) {
+		memset(&cl, 0, sizeof(struct cachelog));
+		cl.line = dl->line;
+		cl.ident = cbuf_str(&b[CSECT_STRS], dl->ident, &ok);
+		cl.program = cbuf_str(&b[CSECT_STRS], dl->program, &ok);
+		cl.vendor = cbuf_str(&b[CSECT_STRS], dl->vendor, &ok);
+		cl.product = cbuf_str(&b[CSECT_STRS], dl->product, &ok);
+		cl.model = cbuf_str(&b[CSECT_STRS], dl->model, &ok);
+		ok = ok && cbuf_add(&b[CSECT_LOGS], &cl, sizeof(cl));
+		if (NULL == (logs = reallocarray
+		    (logs, logsz + 1, sizeof(struct dlog *))))
+			err(EXIT_FAILURE, NULL);
+		logs[logsz++] = dl;
+		hdr.ndlogs++;
+	}
+
+	j = 0;
+	TAILQ_FOREACH(d, &pf->dives, entries) {
+		memset(&cd, 0, sizeof(struct cachedive));
+		cd.datetime = d->datetime;
+		cd.pid = d->pid;
+		cd.num = d->num;
+		cd.duration = d->duration;
+		cd.maxtime = d->maxtime;
+		cd.line = d->line;
+		cd.col = d->col;
+		cd.maxdepth = d->maxdepth;
+		cd.maxtemp = d->maxtemp;
+		cd.mintemp = d->mintemp;
+		cd.gas = hdr.ngas;
+		cd.cyls = hdr.ncyls;
+		cd.samps = hdr.nsamps;
+		cd.nsamps = d->nsamps;
+		cd.gassz = d->gassz;
+		cd.cylsz = d->cylsz;
+		cd.mode = d->mode;
+		cd.hastemp = d->hastemp;
+
+		/* Dives come in divelog order. */
+
+		while (j < logsz && logs[j] != d->log)
+			j++;
+		assert(j < logsz);
+		cd.log = j;
+		cd.fprint = cbuf_str(&b[CSECT_STRS], d->fprint, &ok);
+		assert(d->pid > 0 && d->pid <= pp->datesz);
+		cd.date = cbuf_str(&b[CSECT_STRS], 
+			pp->dates[d->pid - 1], &ok);
+		ok = ok && cbuf_add(&b[CSECT_DIVES], &cd, sizeof(cd));
+
+		for (i = 0; i < d->gassz; i++) {
+			cg.o2 = d->gas[i].o2;
+			cg.n2 = d->gas[i].n2;
+			cg.he = d->gas[i].he;
+			cg.num = d->gas[i].num;
+			ok = ok && cbuf_add
+				(&b[CSECT_GAS], &cg, sizeof(cg));
+		}
+		hdr.ngas += d->gassz;
+
+		for (i = 0; i < d->cylsz; i++) {
+			cc.num = d->cyls[i].num;
+			cc.mix = d->cyls[i].mix;
+			cc.size = d->cyls[i].size;
+			cc.workpressure = d->cyls[i].workpressure;
+			ok = ok && cbuf_add
+				(&b[CSECT_CYLS], &cc, sizeof(cc));
+		}
+		hdr.ncyls += d->cylsz;
+
+		/*
+		 * Samples are written from the columns.
+		 * Other fields come from the dive's samples, which are
+		 * in step with the columns unless compact, when only
+		 * those marked SAMP_EXTRA have one.
+		 */
+
+		c = &d->cols;
+		assert(c->sz == d->nsamps);
+		ok = ok && cbuf_add(&b[CSECT_DEPTH], 
+			c->depth, c->sz * sizeof(double));
+		ok = ok && cbuf_add(&b[CSECT_TEMP], 
+			c->temp, c->sz * sizeof(double));
+		ok = ok && cbuf_add(&b[CSECT_CNS], 
+			c->cns, c->sz * sizeof(double));
+
+		next = TAILQ_FIRST(&d->samps);
+		for (k = 0; k < c->sz; k++) {
+			v = c->time[k];
+			ok = ok && cbuf_add(&b[CSECT_TIME], &v, sizeof(v));
+
+			memset(&cs, 0, sizeof(struct cachesamp));
+			cs.flags = c->flags[k] & ~SAMP_EXTRA;
+			if (pf->stat.compact && 
+			    ! (SAMP_EXTRA & c->flags[k])) {
+				ok = ok && cbuf_add
+					(&b[CSECT_SAMPS], &cs, sizeof(cs));
+				hdr.nsamps++;
+				continue;
+			}
+
+			assert(NULL != next);
+			s = next;
+			next = TAILQ_NEXT(s, entries);
+			cs.rbt = s->rbt;
+			cs.gaschange = s->gaschange;
+			cs.line = s->line;
+			cs.col = s->col;
+			cs.decoduration = s->deco.duration;
+			cs.vendortype = s->vendor.type;
+			cs.decodepth = s->deco.depth;
+			cs.decotype = s->deco.type;
+			cs.vendor = cbuf_mem(&b[CSECT_STRS], 
+				s->vendor.buf, s->vendor.bufsz, &ok);
+			cs.vendorsz = s->vendor.bufsz;
+			cs.pressuresz = s->pressuresz;
+			cs.eventsz = s->eventsz;
+			ok = ok && cbuf_add
+				(&b[CSECT_SAMPS], &cs, sizeof(cs));
+
+			for (i = 0; i < s->pressuresz; i++) {
+				cp.tank = s->pressure[i].tank;
+				cp.pressure = s->pressure[i].pressure;
+				ok = ok && cbuf_add
+					(&b[CSECT_PRES], &cp, sizeof(cp));
+			}
+			hdr.npres += s->pressuresz;
+
+			for (i = 0; i < s->eventsz; i++) {
+				memset(&ce, 0, sizeof(struct cacheevent));
+				ce.duration = s->events[i].duration;
+				ce.flags = s->events[i].flags;
+				ce.type = s->events[i].type;
+				ok = ok && cbuf_add
+					(&b[CSECT_EVENTS], &ce, sizeof(ce));
+			}
+			hdr.nevents += s->eventsz;
+			hdr.nsamps++;
+		}
+		hdr.ndives++;
+	}
+
+	free(logs);
+	hdr.strsz = b[CSECT_STRS].sz;
+
+	if ( ! ok)
+		warn("%s", path);
+	else
+		cbuf_commit(tmp, path, &hdr, sizeof(hdr), b, CSECT__MAX);
+
+	for (i = 0; i < CSECT__MAX; i++)
+		free(b[i].buf);
+}
+
+/*
+ * Try to load the cache for the file with status "sb" from "dir" into
+ * "pf", just as if it had been parsed by parse_file().
+ * Anything amiss with the cache (it doesn't exist, it's for another
+ * version of the file, it's corrupt, etc.) simply means we can't use
+ * it: the cache is fully checked before anything is loaded.
+ * Returns zero if the cache can't be used, non-zero if it's loaded.
+ */
+static int
+cache_read(struct pfile *pf, const char *dir, const struct stat *sb)
+{
+	struct parse		  mp;
+	struct stat		  st;
+	struct cachehdr		  hdr;
+	const struct cachelog	 *cl;
+	const struct cachedive	 *cd;
+	const struct cachesamp	 *cs;
+	const struct cachepres	 *cp;
+	const struct cacheevent	 *ce;
+	const struct cachegas	 *cg;
+	const struct cachecyl	 *cc;
+	const uint64_t		 *ctimes;
+	const double		 *cdepths, *ctemps, *ccnss;
+	const char		 *strs, *str;
+	struct dlog		**logs = NULL;
+	struct dive		 *d;
+	struct samp		 *s, *sv;
+	const struct dlog	 *dl = NULL;
+	char			  path[PATH_MAX];
+	char			 *map = MAP_FAILED;
+	size_t			  i, j, k, off, sz = 0, pres, evs;
+	uint64_t		  n[CSECT__MAX], recsz[CSECT__MAX];
+	uint32_t		  want;
+	int			  fd, rc = 0;
+
+	/* Compact parses don't need sample positions. */
+
+	want = pf->stat.want;
+	if ( ! pf->stat.compact)
+		want |= CACHE_POSITIONS;
+
+	if ( ! cache_path(path, sizeof(path), dir, sb))
+		return 0;
+	if (-1 == (fd = open(path, O_RDONLY, 0)))
+		return 0;
+	if (-1 == fstat(fd, &st) || 
+	    st.st_size < (off_t)sizeof(struct cachehdr) ||
+	    (uintmax_t)st.st_size > SIZE_MAX)
+		goto out;
+	sz = st.st_size;
+	if (MAP_FAILED == (map = mmap
+	    (NULL, sz, PROT_READ, MAP_PRIVATE, fd, 0)))
+		goto out;
+
+	/* Is this a cache for the file as it is now? */
+
+	memcpy(&hdr, map, sizeof(struct cachehdr));
+	if (memcmp(hdr.magic, CACHE_MAGIC, sizeof(hdr.magic)) ||
+	    CACHE_VERSION != hdr.version ||
+	    CACHE_ENDIAN != hdr.endian ||
+	    (uint64_t)sb->st_dev != hdr.dev ||
+	    (uint64_t)sb->st_ino != hdr.ino ||
+	    (uint64_t)sb->st_size != hdr.size ||
+	    (int64_t)sb->st_mtim.tv_sec != hdr.mtime ||
+	    (int64_t)sb->st_mtim.tv_nsec != hdr.mtimens ||
+	    (hdr.want & want) != want)
+		goto out;
+
+	/* Lay out the sections and make sure they fit. */
+
+	n[CSECT_LOGS] = hdr.ndlogs;
+	n[CSECT_DIVES] = hdr.ndives;
+	n[CSECT_GAS] = hdr.ngas;
+	n[CSECT_CYLS] = hdr.ncyls;
+	n[CSECT_TIME] = n[CSECT_DEPTH] = n[CSECT_TEMP] = 
+		n[CSECT_CNS] = n[CSECT_SAMPS] = hdr.nsamps;
+	n[CSECT_PRES] = hdr.npres;
+	n[CSECT_EVENTS] = hdr.nevents;
+	n[CSECT_STRS] = hdr.strsz;
+	recsz[CSECT_LOGS] = sizeof(struct cachelog);
+	recsz[CSECT_DIVES] = sizeof(struct cachedive);
+	recsz[CSECT_GAS] = sizeof(struct cachegas);
+	recsz[CSECT_CYLS] = sizeof(struct cachecyl);
+	recsz[CSECT_TIME] = sizeof(uint64_t);
+	recsz[CSECT_DEPTH] = recsz[CSECT_TEMP] = 
+		recsz[CSECT_CNS] = sizeof(double);
+	recsz[CSECT_SAMPS] = sizeof(struct cachesamp);
+	recsz[CSECT_PRES] = sizeof(struct cachepres);
+	recsz[CSECT_EVENTS] = sizeof(struct cacheevent);
+	recsz[CSECT_STRS] = 1;
+
+	off = sizeof(struct cachehdr);
+	for (i = 0; i < CSECT__MAX; i++) {
+		if (n[i] > (sz - off) / recsz[i])
+			goto out;
+		off += n[i] * recsz[i];
+	}
+	if (off != sz)
+		goto out;
+
+	off = sizeof(struct cachehdr);
+	cl = (const struct cachelog *)(map + off);
+	off += n[CSECT_LOGS] * recsz[CSECT_LOGS];
+	cd = (const struct cachedive *)(map + off);
+	off += n[CSECT_DIVES] * recsz[CSECT_DIVES];
+	cg = (const struct cachegas *)(map + off);
+	off += n[CSECT_GAS] * recsz[CSECT_GAS];
+	cc = (const struct cachecyl *)(map + off);
+	off += n[CSECT_CYLS] * recsz[CSECT_CYLS];
+	ctimes = (const uint64_t *)(map + off);
+	off += n[CSECT_TIME] * recsz[CSECT_TIME];
+	cdepths = (const double *)(map + off);
+	off += n[CSECT_DEPTH] * recsz[CSECT_DEPTH];
+	ctemps = (const double *)(map + off);
+	off += n[CSECT_TEMP] * recsz[CSECT_TEMP];
+	ccnss = (const double *)(map + off);
+	off += n[CSECT_CNS] * recsz[CSECT_CNS];
+	cs = (const struct cachesamp *)(map + off);
+	off += n[CSECT_SAMPS] * recsz[CSECT_SAMPS];
+	cp = (const struct cachepres *)(map + off);
+	off += n[CSECT_PRES] * recsz[CSECT_PRES];
+	ce = (const struct cacheevent *)(map + off);
+	off += n[CSECT_EVENTS] * recsz[CSECT_EVENTS];
+	strs = map + off;
+
+	/* Check every reference before we use any of them. */
+
+	if (0 == hdr.strsz || '\0' != strs[hdr.strsz - 1])
+		goto out;
+	for (i = 0; i < hdr.ndlogs; i++)
+		if (cl[i].ident > hdr.strsz ||
+		    cl[i].program > hdr.strsz ||
+		    cl[i].vendor > hdr.strsz ||
+		    cl[i].product > hdr.strsz ||
+		    cl[i].model > hdr.strsz)
+			goto out;
+	for (i = k = pres = evs = 0; i < hdr.ndives; i++) {
+		if (cd[i].log >= hdr.ndlogs ||
+		    cd[i].fprint > hdr.strsz ||
+		    cd[i].date > hdr.strsz ||
+		    cd[i].mode > MODE_CC ||
+		    cd[i].gas > hdr.ngas ||
+		    cd[i].gassz > hdr.ngas - cd[i].gas ||
+		    cd[i].cyls > hdr.ncyls ||
+		    cd[i].cylsz > hdr.ncyls - cd[i].cyls ||
+		    cd[i].samps != k ||
+		    cd[i].nsamps > hdr.nsamps - k)
+			goto out;
+		k += cd[i].nsamps;
+	}
+	for (i = 0; i < hdr.nsamps; i++) {
+		if (cs[i].vendor > hdr.strsz ||
+		    (0 == cs[i].vendor && cs[i].vendorsz) ||
+		    (cs[i].vendor && 
+		     cs[i].vendorsz >= hdr.strsz - (cs[i].vendor - 1)) ||
+		    cs[i].decotype >= DECO__MAX ||
+		    cs[i].pressuresz > hdr.npres - pres ||
+		    cs[i].eventsz > hdr.nevents - evs)
+			goto out;
+		pres += cs[i].pressuresz;
+		evs += cs[i].eventsz;
+	}
+	for (i = 0; i < hdr.nevents; i++)
+		if (ce[i].type >= EVENT__MAX)
+			goto out;
+
+	/* It's good: load it as if parsed. */
+
+	memset(&mp, 0, sizeof(struct parse));
+	mp.file = pf->fname;
+	mp.dives = &pf->dives;
+	mp.stat = &pf->stat;
+	mp.quiet = 1;
+
+	if (hdr.ndlogs && NULL == (logs = reallocarray
+	    (NULL, hdr.ndlogs, sizeof(struct dlog *))))
+		logfatal(&mp, "reallocarray");
+
+	for (i = 0; i < hdr.ndlogs; i++) {
+		logs[i] = xcalloc(&mp, 1, sizeof(struct dlog));
+		logs[i]->file = xstrdup(&mp, pf->fname);
+		logs[i]->line = cl[i].line;
+		if (NULL != (str = cache_str(strs, hdr.strsz, cl[i].ident)))
+			logs[i]->ident = xstrdup(&mp, str);
+		if (NULL != (str = cache_str(strs, hdr.strsz, cl[i].program)))
+			logs[i]->program = xstrdup(&mp, str);
+		if (NULL != (str = cache_str(strs, hdr.strsz, cl[i].vendor)))
+			logs[i]->vendor = xstrdup(&mp, str);
+		if (NULL != (str = cache_str(strs, hdr.strsz, cl[i].product)))
+			logs[i]->product = xstrdup(&mp, str);
+		if (NULL != (str = cache_str(strs, hdr.strsz, cl[i].model)))
+			logs[i]->model = xstrdup(&mp, str);
+		TAILQ_INSERT_TAIL(&pf->stat.dlogs, logs[i], entries);
+	}
+
+	for (i = pres = evs = 0; i < hdr.ndives; i++, cd++) {
+		d = xcalloc(&mp, 1, sizeof(struct dive));
+		TAILQ_INIT(&d->samps);
+		d->pid = cd->pid;
+		d->datetime = cd->datetime;
+		d->num = cd->num;
+		d->duration = cd->duration;
+		d->mode = cd->mode;
+		d->maxdepth = cd->maxdepth;
+		d->hastemp = cd->hastemp;
+		d->maxtemp = cd->maxtemp;
+		d->mintemp = cd->mintemp;
+		d->maxtime = cd->maxtime;
+		d->nsamps = cd->nsamps;
+		d->line = cd->line;
+		d->col = cd->col;
+		d->log = logs[cd->log];
+		if (NULL != (str = cache_str(strs, hdr.strsz, cd->fprint)))
+			dive_fprint(&mp, d, str, strlen(str));
+
+		if ((d->gassz = cd->gassz) > 0) {
+			d->gas = xcalloc(&mp, 
+				d->gassz, sizeof(struct divegas));
+			for (j = 0; j < d->gassz; j++) {
+				d->gas[j].o2 = cg[cd->gas + j].o2;
+				d->gas[j].n2 = cg[cd->gas + j].n2;
+				d->gas[j].he = cg[cd->gas + j].he;
+				d->gas[j].num = cg[cd->gas + j].num;
+			}
+		}
+
+		if ((d->cylsz = cd->cylsz) > 0) {
+			d->cyls = xcalloc(&mp, 
+				d->cylsz, sizeof(struct cylinder));
+			for (j = 0; j < d->cylsz; j++) {
+				d->cyls[j].num = cc[cd->cyls + j].num;
+				d->cyls[j].mix = cc[cd->cyls + j].mix;
+				d->cyls[j].size = cc[cd->cyls + j].size;
+				d->cyls[j].workpressure = 
+					cc[cd->cyls + j].workpressure;
+			}
+		}
+
+		for (j = 0, k = cd->samps; j < d->nsamps; j++, k++)
+			if (SAMP_TEMP & cs[k].flags) {
+				d->sumtemp += ctemps[k];
+				d->ntemps++;
+			}
+
+		/* 
+		 * Samples are contiguous, so columns are copied.
+		 * (There are no columns in summary parses.)
+		 * Compact parses only have samples for those with
+		 * fields not in the columns.
+		 */
+
+		dive_cols_alloc(&mp, d);
+		k = cd->samps;
+		if (d->cols.sz) {
+			memcpy(d->cols.depth, &cdepths[k], 
+				d->nsamps * sizeof(double));
+			memcpy(d->cols.temp, &ctemps[k], 
+				d->nsamps * sizeof(double));
+			memcpy(d->cols.cns, &ccnss[k], 
+				d->nsamps * sizeof(double));
+		}
+		if (d->cols.sz && ! pf->stat.compact)
+			sv = xarena_calloc(&mp, d, 
+				d->nsamps, sizeof(struct samp));
+		else
+			sv = NULL;
+
+		for (j = 0; j < d->cols.sz; j++, k++) {
+			d->cols.time[j] = ctimes[k];
+			d->cols.flags[j] = cs[k].flags & pf->stat.want;
+			if (NULL != sv) {
+				s = &sv[j];
+			} else if ((SAMP_RARE & d->cols.flags[j]) ||
+			    ((WANT_PRESSURE & pf->stat.want) && 
+			     cs[k].pressuresz) ||
+			    ((WANT_EVENTS & pf->stat.want) && 
+			     cs[k].eventsz)) {
+				s = xarena_calloc(&mp, d, 
+					1, sizeof(struct samp));
+				d->cols.flags[j] |= SAMP_EXTRA;
+			} else {
+				pres += cs[k].pressuresz;
+				evs += cs[k].eventsz;
+				continue;
+			}
+
+			s->time = ctimes[k];
+			s->depth = cdepths[k];
+			s->temp = ctemps[k];
+			s->cns = ccnss[k];
+			s->rbt = cs[k].rbt;
+			s->gaschange = cs[k].gaschange;
+			s->deco.depth = cs[k].decodepth;
+			s->deco.type = cs[k].decotype;
+			s->deco.duration = cs[k].decoduration;
+			s->flags = cs[k].flags & pf->stat.want;
+			s->line = cs[k].line;
+			s->col = cs[k].col;
+			if (SAMP_VENDOR & s->flags) {
+				s->vendor.type = cs[k].vendortype;
+				s->vendor.bufsz = cs[k].vendorsz;
+			}
+			if (s->vendor.bufsz)
+				s->vendor.buf = xarena_memdup(&mp, d, 
+					strs + cs[k].vendor - 1, 
+					s->vendor.bufsz);
+
+			/* Skip over unwanted pressures and events. */
+
+			if ( ! (WANT_PRESSURE & pf->stat.want)) {
+				pres += cs[k].pressuresz;
+			} else if ((s->pressuresz = cs[k].pressuresz) > 0)
+				s->pressure = xarena_calloc(&mp, d,
+					s->pressuresz, 
+					sizeof(struct samppres));
+			for (off = 0; off < s->pressuresz; off++, pres++) {
+				s->pressure[off].tank = cp[pres].tank;
+				s->pressure[off].pressure = 
+					cp[pres].pressure;
+			}
+
+			if ( ! (WANT_EVENTS & pf->stat.want)) {
+				evs += cs[k].eventsz;
+			} else if ((s->eventsz = cs[k].eventsz) > 0)
+				s->events = xarena_calloc(&mp, d,
+					s->eventsz, 
+					sizeof(struct sampevent));
+			for (off = 0; off < s->eventsz; off++, evs++) {
+				s->events[off].duration = 
+					ce[evs].duration;
+				s->events[off].flags = ce[evs].flags;
+				s->events[off].type = ce[evs].type;
+			}
+
+			TAILQ_INSERT_TAIL(&d->samps, s, entries);
+		}
+
+		/* Group as if we'd just parsed the <dive>. */
+
+		if (d->log != dl) {
+			dl = d->log;
+			mp.loggroup = NULL;
+		}
+		mp.curdive = d;
+		dive_add(&mp, d, cache_str(strs, hdr.strsz, cd->date));
+		mp.curdive = NULL;
+	}
+
+	free(logs);
+	rc = 1;
+out:
+	if (MAP_FAILED != map)
+		munmap(map, sz);
+	close(fd);
+	return rc;
+}
+
+/*
+ * In a partial parse, add the next dive in the index as if it had been
+ * parsed, but without its samples, gas mixes, or cylinders.
+ */
+static void
+dive_stub(struct parse *p)
+{
+	struct ifeed		*f = p->feed;
+	const struct idxdive	*id = &f->dives[f->next++];
+	struct dive		*d;
+	const char		*fprint;
+
+	d = xcalloc(p, 1, sizeof(struct dive));
+	d->pid = p->pid = f->next;
+	d->line = id->line;
+	d->col = id->col;
+	TAILQ_INIT(&d->samps);
+	d->log = p->curlog;
+	d->datetime = id->datetime;
+	d->num = id->num;
+	d->duration = id->duration;
+	d->mode = id->mode;
+	d->maxdepth = id->maxdepth;
+	if (NULL != (fprint = cache_str(f->strs, f->strsz, id->fprint)))
+		dive_fprint(p, d, fprint, strlen(fprint));
+
+	/* Report from the dive's position in the file. */
+
+	p->curdive = d;
+	f->line = XML_GetCurrentLineNumber(p->p);
+	f->col = XML_GetCurrentColumnNumber(p->p);
+	dive_add(p, d, cache_str(f->strs, f->strsz, id->date));
+	dive_cols(p, d);
+	group_key(p, d);
+	p->curdive = NULL;
+}
+
+/*
+ * Where the sidecar index of "fname" lives.
+ * Returns zero if the name doesn't fit in "buf" of size "sz".
+ */
+static int
+idx_path(char *buf, size_t sz, const char *fname)
+{
+	int	 c;
+
+	c = snprintf(buf, sz, "%s.idx", fname);
+	return c > 0 && (size_t)c < sz;
+}
+
+/*
+ * Write the sidecar index of "pf" (with the byte range and <dive> date
+ * of each dive, by parse identifier, in "pp"), to be used in place of
+ * fully parsing the file with status "sb" until it changes.
+ * Like the cache, the index is written to a temporary file then
+ * renamed into place and failures aren't fatal.
+ */
+static void
+idx_write(const struct pfile *pf, const struct parse *pp,
+	const struct stat *sb)
+{
+	struct cbuf	 	 b[2]; /* dives, strings */
+	struct idxhdr		 hdr;
+	struct idxdive		 id;
+	const struct dive	*d;
+	const struct irange	*r;
+	char			 path[PATH_MAX], tmp[PATH_MAX];
+	int			 ok;
+
+	/* Multiple divelogs can't be fed dive by dive. */
+
+	if (TAILQ_FIRST(&pf->stat.dlogs) != 
+	    TAILQ_LAST(&pf->stat.dlogs, dlogq))
+		return;
+
+	if ( ! idx_path(path, sizeof(path), pf->fname) ||
+	    (size_t)snprintf(tmp, sizeof(tmp), 
+	     "%s.XXXXXXXXXX", path) >= sizeof(tmp)) {
+		warnx("%s: index path too long", pf->fname);
+		return;
+	}
+
+	memset(b, 0, sizeof(b));
+	memset(&hdr, 0, sizeof(struct idxhdr));
+	memcpy(hdr.magic, IDX_MAGIC, sizeof(hdr.magic));
+	hdr.version = IDX_VERSION;
+	hdr.endian = CACHE_ENDIAN;
+	hdr.dev = sb->st_dev;
+	hdr.ino = sb->st_ino;
+	hdr.size = hdr.head = hdr.tail = sb->st_size;
+	hdr.mtime = sb->st_mtim.tv_sec;
+	hdr.mtimens = sb->st_mtim.tv_nsec;
+
+	ok = cbuf_add(&b[1], "", 1);
+
+	TAILQ_FOREACH(d, &pf->dives, entries) {
+		assert(d->pid == hdr.ndives + 1);
+		assert(d->pid <= pp->rangesz);
+		r = &pp->ranges[d->pid - 1];
+		if (0 == hdr.ndives)
+			hdr.head = r->off;
+		hdr.tail = r->off + r->len;
+		memset(&id, 0, sizeof(struct idxdive));
+		id.off = r->off;
+		id.len = r->len;
+		id.datetime = d->datetime;
+		id.num = d->num;
+		id.duration = d->duration;
+		id.line = d->line;
+		id.col = d->col;
+		id.maxdepth = d->maxdepth;
+		id.mode = d->mode;
+		id.fprint = cbuf_str(&b[1], d->fprint, &ok);
+		assert(d->pid <= pp->datesz);
+		id.date = cbuf_str(&b[1], pp->dates[d->pid - 1], &ok);
+		ok = ok && cbuf_add(&b[0], &id, sizeof(id));
+		hdr.ndives++;
+	}
+
+	hdr.strsz = b[1].sz;
+
+	if ( ! ok)
+		warn("%s", path);
+	else
+		cbuf_commit(tmp, path, &hdr, sizeof(hdr), b, 2);
+
+	free(b[0].buf);
+	free(b[1].buf);
+}
+
+/*
+ * Try to read the sidecar index of "pf", with status "sb", choosing
+ * the dives to be parsed with the file's selector.
+ * As with the cache, an index that's stale or corrupt isn't used.
+ * Returns zero if the index can't be used, non-zero if it's been read
+ * into "f", which must then be released with idx_free().
+ */
+static int
+idx_read(const struct pfile *pf, const struct stat *sb, struct ifeed *f)
+{
+	struct stat		 st;
+	struct idxhdr		 hdr;
+	struct dindex		 di;
+	const struct idxdive	*id;
+	char			 path[PATH_MAX];
+	size_t			 i;
+	uint64_t		 end;
+	int			 fd;
+
+	memset(f, 0, sizeof(struct ifeed));
+	f->map = MAP_FAILED;
+
+	if ( ! idx_path(path, sizeof(path), pf->fname))
+		return 0;
+	if (-1 == (fd = open(path, O_RDONLY, 0)))
+		return 0;
+	if (-1 == fstat(fd, &st) || 
+	    st.st_size < (off_t)sizeof(struct idxhdr) ||
+	    (uintmax_t)st.st_size > SIZE_MAX) {
+		close(fd);
+		return 0;
+	}
+	f->mapsz = st.st_size;
+	f->map = mmap(NULL, f->mapsz, PROT_READ, MAP_PRIVATE, fd, 0);
 	close(fd);
-	free(pp.buf);
-	return 0 == ssz;
+	if (MAP_FAILED == f->map)
+		return 0;
+
+	/* Is this an index for the file as it is now? */
+
+	memcpy(&hdr, f->map, sizeof(struct idxhdr));
+	if (memcmp(hdr.magic, IDX_MAGIC, sizeof(hdr.magic)) ||
+	    IDX_VERSION != hdr.version ||
+	    CACHE_ENDIAN != hdr.endian ||
+	    (uint64_t)sb->st_dev != hdr.dev ||
+	    (uint64_t)sb->st_ino != hdr.ino ||
+	    (uint64_t)sb->st_size != hdr.size ||
+	    (int64_t)sb->st_mtim.tv_sec != hdr.mtime ||
+	    (int64_t)sb->st_mtim.tv_nsec != hdr.mtimens ||
+	    hdr.size > SIZE_MAX)
+		goto bad;
+
+	if (hdr.ndives > (f->mapsz - sizeof(struct idxhdr)) / 
+	     sizeof(struct idxdive) ||
+	    sizeof(struct idxhdr) + hdr.ndives * 
+	     sizeof(struct idxdive) + hdr.strsz != f->mapsz ||
+	    0 == hdr.strsz)
+		goto bad;
+
+	id = (const struct idxdive *)(f->map + sizeof(struct idxhdr));
+	f->strs = (const char *)(id + hdr.ndives);
+	f->strsz = hdr.strsz;
+	if ('\0' != f->strs[hdr.strsz - 1])
+		goto bad;
+
+	/* Dives must be in order and between the head and tail. */
+
+	if (hdr.head > hdr.tail || hdr.tail > hdr.size)
+		goto bad;
+	for (end = hdr.head, i = 0; i < hdr.ndives; i++) {
+		if (id[i].off < end || 
+		    id[i].len > hdr.tail - id[i].off ||
+		    id[i].mode > MODE_CC)
+			goto bad;
+		end = id[i].off + id[i].len;
+	}
+	if (hdr.ndives && end != hdr.tail)
+		goto bad;
+
+	f->head = hdr.head;
+	f->tail = hdr.tail;
+	f->size = hdr.size;
+	f->dives = id;
+	f->divesz = hdr.ndives;
+	if (NULL == (f->chosen = calloc(f->divesz + 1, 1)))
+		err(EXIT_FAILURE, NULL);
+
+	for (i = 0; i < f->divesz; i++) {
+		memset(&di, 0, sizeof(struct dindex));
+		di.pid = i + 1;
+		di.datetime = id[i].datetime;
+		di.duration = id[i].duration;
+		di.mode = id[i].mode;
+		di.maxdepth = id[i].maxdepth;
+		di.fprint = cache_str(f->strs, f->strsz, id[i].fprint);
+		f->chosen[i] = 0 != pf->sel(&di, pf->arg);
+	}
+
+	return 1;
+bad:
+	munmap(f->map, f->mapsz);
+	return 0;
+}
+
+static void
+idx_free(struct ifeed *f)
+{
+
+	munmap(f->map, f->mapsz);
+	free(f->chosen);
+}
+
+/*
+ * Parse a file into its own dive queue and statistics (which must
+ * have been initialised with pfile_init()), to be merged with
+ * merge_file().
+ * Dives are left in parse order and in groups local to the file.
+ * If the file has a selector and a current index, only the dives it
+ * chooses are parsed in full.
+ */
+static int
+parse_pfile(XML_Parser p, struct pfile *pf)
+{
+	struct parse	 pp;
+	struct stat	 sb, nsb;
+	struct ifeed	 feed;
+	const char	*dir, *cp;
+	size_t		 i;
+	int		 rc, regular, indexing;
+
+	regular = strcmp("-", pf->fname) && -1 != stat(pf->fname, &sb);
+
+	/*
+	 * If we're choosing dives and have an index, parse only those
+	 * chosen; or if the index isn't current, parse the whole file
+	 * (without the cache) to refresh it.
+	 */
+
+	indexing = regular && NULL != pf->sel &&
+		NULL != (cp = getenv("DCMD_INDEX")) && '\0' != *cp;
+	if (indexing && ! verbose && idx_read(pf, &sb, &feed)) {
+		memset(&pp, 0, sizeof(struct parse));
+		pp.dives = &pf->dives;
+		pp.stat = &pf->stat;
+		pp.quiet = 1;
+		pp.feed = &feed;
+		rc = parse_file(p, &pp, pf->fname);
+		idx_free(&feed);
+		return rc;
+	}
+
+	/*
+	 * If we've a cache directory, use the file's cache if it's
+	 * current, or parse and refresh it.
+	 * In verbose mode, always parse for the diagnostics.
+	 */
+
+	if (NULL != (dir = getenv("DCMD_CACHE")) && 
+	    ('\0' == *dir || ! regular))
+		dir = NULL;
+	if (NULL != dir && ! verbose && ! indexing && 
+	    cache_read(pf, dir, &sb))
+		return 1;
+
+	memset(&pp, 0, sizeof(struct parse));
+	pp.dives = &pf->dives;
+	pp.stat = &pf->stat;
+	pp.quiet = 1;
+	pp.caching = NULL != dir && ! pf->stat.summary;
+	pp.indexing = indexing;
+	rc = parse_file(p, &pp, pf->fname);
+
+	/* Only cache or index clean parses of unchanged files. */
+
+	if (rc && 0 == pp.warns && regular &&
+	    -1 != stat(pf->fname, &nsb) &&
+	    sb.st_dev == nsb.st_dev && sb.st_ino == nsb.st_ino &&
+	    sb.st_size == nsb.st_size &&
+	    sb.st_mtim.tv_sec == nsb.st_mtim.tv_sec &&
+	    sb.st_mtim.tv_nsec == nsb.st_mtim.tv_nsec) {
+		if (pp.caching)
+			cache_write(pf, &pp, dir, &sb);
+		if (indexing && ! pp.noidx &&
+		    (SAMP_DEPTH & pf->stat.want))
+			idx_write(pf, &pp, &sb);
+	}
+
+	for (i = 0; i < pp.pid && i < pp.datesz; i++)
+		free(pp.dates[i]);
+	free(pp.dates);
+	free(pp.ranges);
+	return rc;
+}
+
+static void
+pfile_init(struct pfile *pf, const char *fname, const struct divestat *st)
+{
+
+	memset(pf, 0, sizeof(struct pfile));
+	pf->fname = fname;
+	TAILQ_INIT(&pf->dives);
+	TAILQ_INIT(&pf->stat.dlogs);
+	pf->stat.group = st->group;
+	pf->stat.groupsort = st->groupsort;
+	pf->stat.summary = st->summary;
+	pf->stat.want = st->want;
+	pf->stat.compact = st->compact;
+}
+
+/*
+ * Move the dives and divelogs parsed by parse_pfile() into "dq" and
+ * "st", then release what's left of the file's statistics.
+ * Dives are assigned to the groups of "st" in parse order, creating
+ * groups as needed, so merging files in sequence gives the same groups
+ * as if they had been parsed into "st" directly.
+ */
+static void
+merge_file(struct pfile *pf, struct diveq *dq, struct divestat *st)
+{
+	struct parse	 mp;
+	struct dive	*d;
+	struct dgroup	*dg;
+	const struct dlog *dl = NULL;
+	size_t		 i;
+
+	memset(&mp, 0, sizeof(struct parse));
+	mp.file = strcmp("-", pf->fname) ? pf->fname : "<stdin>";
+	mp.dives = dq;
+	mp.stat = st;
+
+	while (NULL != (d = TAILQ_FIRST(&pf->dives))) {
+		TAILQ_REMOVE(&pf->dives, d, entries);
+		if (d->log != dl) {
+			dl = d->log;
+			mp.loggroup = NULL;
+		}
+
+		if (GROUP_DATE == st->group || 
+		    GROUP_DIVER == st->group) {
+			assert(NULL != d->group->name);
+			dg = group_lookup_name(&mp, d, d->group->name);
+		} else if (GROUP_DIVELOG == st->group) {
+			dg = group_lookup_divelog(&mp, d);
+		} else if (0 == st->groupsz) {
+			if (verbose)
+				fprintf(stderr, "%s:%zu:%zu: new "
+					"default group\n", mp.file, 
+					d->line, d->col);
+			dg = group_alloc(&mp, d, NULL);
+		} else
+			dg = group_add(&mp, 0, d);
+
+		assert(dg == d->group);
+		if (d->datetime &&
+		    (0 == dg->mintime || d->datetime < dg->mintime))
+			dg->mintime = d->datetime;
+
+		group_key(&mp, d);
+		TAILQ_INSERT_TAIL(dq, d, entries);
+	}
+
+	if (pf->stat.timestamp_min &&
+	    (0 == st->timestamp_min || 
+	     pf->stat.timestamp_min < st->timestamp_min))
+		st->timestamp_min = pf->stat.timestamp_min;
+	if (pf->stat.timestamp_max > st->timestamp_max)
+		st->timestamp_max = pf->stat.timestamp_max;
+
+	TAILQ_CONCAT(&st->dlogs, &pf->stat.dlogs, entries);
+
+	for (i = 0; i < pf->stat.groupsz; i++) {
+		free(pf->stat.groups[i]->name);
+		free(pf->stat.groups[i]);
+	}
+	free(pf->stat.groups);
+	free(pf->stat.groupmap);
+}
+
+/*
+ * Parse a file, accumulating the dives into "dq" and into the group
+ * dives.
+ * Dives in "dq" are ordered, by default, by date.
+ * If a split is specified, however, they're ordered by relative date
+ * from the first dive of the given group.
+ * So for example, if you have GROUP_DATE and two days, the dives will
+ * be ordered by the relative from the beginning of each day's first
+ * dive.
+ * This lets them be interleaved nicely.
+ * If "summary" is set in "st", samples are folded into their dive's
+ * maxima, temperature sum, and sample count, then discarded, so memory
+ * is proportional to the number of dives: dives have no samples or
+ * columns, and sample pressures, events, and vendor data are skipped.
+ * If "compact" is set, samples are kept in their dive's columns, and
+ * only those with other fields are also kept as samples (see struct
+ * sampcols), which takes a fraction of the memory.
+ * Returns zero on failure, non-zero on success.
+ */
+int
+divecmd_parse(const char *fname, XML_Parser p, 
+	struct diveq *dq, struct divestat *st)
+{
+	struct pfile	 pf;
+	int		 rc;
+
+	pfile_init(&pf, fname, st);
+	rc = parse_pfile(p, &pf);
+	merge_file(&pf, dq, st);
+	dives_sort_all(dq, st);
+	return rc;
+}
+
+/*
+ * Like divecmd_parse(), but passing each dive to "cb" (with "arg") as
+ * soon as it has been closed, linked, and assigned to its group in
+ * "st".
+ * If "cb" returns zero, the dive is freed instead of being kept in
+ * "dq"; if less than zero, it's freed and parsing stops with failure.
+ * Dives are passed in parse order; any kept are then ordered in "dq"
+ * as with divecmd_parse().
+ * A caller that keeps no dives parses in memory proportional to the
+ * largest dive, not the file.
+ * Returns zero on failure, non-zero on success.
+ */
+int
+divecmd_parse_stream(const char *fname, XML_Parser p, 
+	struct diveq *dq, struct divestat *st,
+	int (*cb)(struct dive *, void *), void *arg)
+{
+	struct parse	 pp;
+	int		 rc;
+
+	memset(&pp, 0, sizeof(struct parse));
+	pp.dives = dq;
+	pp.stat = st;
+	pp.cb = cb;
+	pp.arg = arg;
+	rc = parse_file(p, &pp, fname);
+	dives_sort_all(dq, st);
+	return rc;
+}
+
+static void *
+parse_worker(void *arg)
+{
+	struct pmany	*pm = arg;
+	XML_Parser	 p;
+	size_t		 i;
+
+	if (NULL == (p = XML_ParserCreate(NULL)))
+		err(EXIT_FAILURE, NULL);
+
+	for (;;) {
+		if ((errno = pthread_mutex_lock(&pm->mtx)))
+			err(EXIT_FAILURE, "pthread_mutex_lock");
+		i = pm->next++;
+		if ((errno = pthread_mutex_unlock(&pm->mtx)))
+			err(EXIT_FAILURE, "pthread_mutex_unlock");
+		if (i >= pm->filesz)
+			break;
+		pm->files[i].rc = parse_pfile(p, &pm->files[i]);
+	}
+
+	XML_ParserFree(p);
+	return NULL;
+}
+
+/*
+ * See divecmd_parse_many() and divecmd_parse_select().
+ */
+static int
+parse_many(const char *const *fnames, size_t sz,
+	struct diveq *dq, struct divestat *st,
+	int (*sel)(const struct dindex *, void *), void *arg)
+{
+	struct pmany	 pm;
+	pthread_t	*thrs;
+	long		 ncpu;
+	size_t		 i, nthrs;
+	int		 rc = 1;
+
+	if (0 == sz)
+		return 1;
+
+	memset(&pm, 0, sizeof(struct pmany));
+	pm.filesz = sz;
+	if (NULL == (pm.files = calloc(sz, sizeof(struct pfile))))
+		err(EXIT_FAILURE, NULL);
+	for (i = 0; i < sz; i++) {
+		pfile_init(&pm.files[i], fnames[i], st);
+		pm.files[i].sel = sel;
+		pm.files[i].arg = arg;
+	}
+	if ((errno = pthread_mutex_init(&pm.mtx, NULL)))
+		err(EXIT_FAILURE, "pthread_mutex_init");
+
+	/* The calling thread is also a worker. */
+
+	ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	nthrs = ncpu < 1 ? 1 : (size_t)ncpu;
+	if (nthrs > sz)
+		nthrs = sz;
+	if (NULL == (thrs = calloc(nthrs, sizeof(pthread_t))))
+		err(EXIT_FAILURE, NULL);
+	for (i = 1; i < nthrs; i++)
+		if ((errno = pthread_create
+		    (&thrs[i], NULL, parse_worker, &pm)))
+			err(EXIT_FAILURE, "pthread_create");
+	parse_worker(&pm);
+	for (i = 1; i < nthrs; i++)
+		if ((errno = pthread_join(thrs[i], NULL)))
+			err(EXIT_FAILURE, "pthread_join");
+	free(thrs);
+	pthread_mutex_destroy(&pm.mtx);
+
+	/* 
+	 * Merge up to and including the first failed file.
+	 * Dives from those after are thrown away.
+	 */
+
+	for (i = 0; i < sz; i++) {
+		if (rc) {
+			merge_file(&pm.files[i], dq, st);
+			dives_sort_all(dq, st);
+			rc = pm.files[i].rc;
+		} else
+			divecmd_free(&pm.files[i].dives, 
+				&pm.files[i].stat);
+	}
+
+	free(pm.files);
+	return rc;
+}
+
+/*
+ * Like calling divecmd_parse() on each of the "sz" files in "fnames"
+ * in order, stopping at the first failure, but with files parsed
+ * concurrently, one parser per thread.
+ * Results are merged in the given order, so "dq" and "st" are the same
+ * as if parsed sequentially.
+ * (Diagnostics, however, may come from any file at any time.)
+ * Returns zero on failure, non-zero on success.
+ */
+int
+divecmd_parse_many(const char *const *fnames, size_t sz,
+	struct diveq *dq, struct divestat *st)
+{
+
+	return parse_many(fnames, sz, dq, st, NULL, NULL);
+}
+
+/*
+ * Like divecmd_parse_many(), but only those dives for which "sel"
+ * (passed "arg") returns non-zero need be parsed in full.
+ * If DCMD_INDEX is set, a sidecar index of each file is kept in the
+ * file's name with ".idx" appended.
+ * With a current index, only the chosen dives are parsed: the others
+ * are filled in from the index, without samples, gas mixes, or
+ * cylinders, so the dives and their order are otherwise unchanged.
+ * As "sel" may be called from any of the parsing threads at once, it
+ * must not modify shared state.
+ * Returns zero on failure, non-zero on success.
+ */
+int
+divecmd_parse_select(const char *const *fnames, size_t sz,
+	struct diveq *dq, struct divestat *st,
+	int (*sel)(const struct dindex *, void *), void *arg)
+{
+
+	return parse_many(fnames, sz, dq, st, sel, arg);
+}
+
+/*
+ * Pass the contents of "fd" (named "fname") to the parser "p".
+ * Regular files are mapped and passed in large chunks; anything else
+ * (pipes, terminals) is read directly into the parser's buffer.
+ * The document is not finalised.
+ * Returns >0 on success, 0 on a parse error (see XML_GetErrorCode()),
+ * and <0 on a read error (which has been reported).
+ */
+int
+divecmd_feed(XML_Parser p, int fd, const char *fname)
+{
+	struct stat	 st;
+	char		*map;
+	void		*buf;
+	size_t		 off, len, sz;
+	ssize_t		 ssz;
+	int		 rc = 1;
+
+	if (-1 != fstat(fd, &st) && S_ISREG(st.st_mode) &&
+	    st.st_size > 0 && (uintmax_t)st.st_size <= SIZE_MAX) {
+		sz = st.st_size;
+		map = mmap(NULL, sz, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (MAP_FAILED != map) {
+#ifdef MADV_SEQUENTIAL
+			(void)madvise(map, sz, MADV_SEQUENTIAL);
+#endif
+			for (off = 0; off < sz && rc > 0; off += len) {
+				len = sz - off > FEED_CHUNK ?
+					FEED_CHUNK : sz - off;
+				if (XML_STATUS_OK != XML_Parse
+				    (p, map + off, (int)len, 0))
+					rc = 0;
+#ifdef MADV_DONTNEED
+				/* Expat has copied what it needs. */
+				(void)madvise(map + off, len, MADV_DONTNEED);
+#endif
+			}
+			munmap(map, sz);
+			return rc;
+		}
+	}
+
+	for (;;) {
+		if (NULL == (buf = XML_GetBuffer(p, FEED_READSZ)))
+			return 0;
+		if ((ssz = read(fd, buf, FEED_READSZ)) < 0) {
+			warn("%s", fname);
+			return -1;
+		} else if (0 == ssz)
+			return 1;
+		if (XML_STATUS_OK != XML_ParseBuffer(p, (int)ssz, 0))
+			return 0;
+	}
+}
+
+/*
+ * Like strtod(3), but parsing the plain decimal numbers that we write
+ * (e.g., "12.34" or "-1.5") quickly and regardless of locale.
+ * Up to 15 digits fit exactly in a double, as do powers of ten up to
+ * 1e22, so a single division gives the correctly-rounded result.
+ * Anything else (exponents, more digits, "inf", leading white-space,
+ * etc.) is passed to strtod(3).
+ */
+double
+divecmd_strtod(const char *nptr, char **endptr)
+{
+	static const double pow10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 
+		1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15 };
+	const char	*cp = nptr;
+	uint64_t	 m = 0;
+	size_t		 nd = 0, nf = 0;
+	int		 neg = 0;
+	double		 v;
+
+	if ('-' == *cp || '+' == *cp)
+		neg = '-' == *cp++;
+	for ( ; *cp >= '0' && *cp <= '9'; cp++, nd++)
+		m = m * 10 + (uint64_t)(*cp - '0');
+	if ('.' == *cp)
+		for (cp++; *cp >= '0' && *cp <= '9'; cp++, nf++)
+			m = m * 10 + (uint64_t)(*cp - '0');
+
+	if (0 == nd + nf || nd + nf > 15 ||
+	    'e' == *cp || 'E' == *cp || 'x' == *cp || 'X' == *cp)
+		return strtod(nptr, endptr);
+
+	v = (double)m / pow10[nf];
+	if (NULL != endptr)
+		*endptr = (char *)cp;
+	return neg ? -v : v;
+}
+
+/*
+ * Map an element or attribute name to its token.
+ * Returns TOKEN__NONE if the name isn't known.
+ */
+enum token
+divecmd_token(const char *s)
+{
+	size_t		 sz;
+	enum token	 tok;
+
+	if ((sz = strlen(s)) < 2)
+		return TOKEN__NONE;
+	tok = tokmap[TOKEN_HASH(sz, (unsigned char)s[0], 
+		(unsigned char)s[1], (unsigned char)s[sz - 1])];
+	if (TOKEN__NONE == tok || strcmp(tokens[tok], s))
+		return TOKEN__NONE;
+	return tok;
+}
+
+/*
+ * Allocate "nm" zeroed members of size "sz" from the memory of dive
+ * "d", which is released with the dive.
+ * This never returns NULL: it exits on memory exhaustion.
+ */
+void *
+divecmd_arena_calloc(struct dive *d, size_t nm, size_t sz)
+{
+	void	*p;
+
+	if (NULL == (p = arena_alloc(d, nm, sz)))
+		err(EXIT_FAILURE, NULL);
+	return p;
+}
+
+/*
+ * Like reallocarray(3), but for memory allocated from dive "d" with
+ * divecmd_arena_calloc(), where "onm" is the current number of members.
+ * Any new members are zeroed.
+ * This never returns NULL: it exits on memory exhaustion.
+ */
+void *
+divecmd_arena_reallocarray(struct dive *d, 
+	void *ptr, size_t onm, size_t nm, size_t sz)
+{
+
+	if (NULL == (ptr = arena_realloc(d, ptr, onm, nm, sz)))
+		err(EXIT_FAILURE, NULL);
+	return ptr;
+}
+
+/*
+ * Add the fingerprint of dive "d", which must have one, to "set".
+ * If it's already in the set, return the existing entry; otherwise,
+ * copy it (with the dive's divelog and line) and return NULL.
+ * The table is grown to keep it under three-quarters full.
+ * This exits on memory exhaustion.
+ */
+const struct fpseen *
+divecmd_fpset_add(struct fpset *set, const struct dive *d)
+{
+	struct fpseen	*slots, *se;
+	size_t		 i, j, sz, mask;
+
+	assert(NULL != d->fprint);
+
+	if (4 * (set->sz + 1) > 3 * set->slotsz) {
+		sz = 0 == set->slotsz ? 64 : set->slotsz * 2;
+		slots = calloc(sz, sizeof(struct fpseen));
+		if (NULL == slots)
+			err(EXIT_FAILURE, NULL);
+		for (i = 0; i < set->slotsz; i++) {
+			if (NULL == set->slots[i].fprint)
+				continue;
+			j = set->slots[i].hash & (sz - 1);
+			while (NULL != slots[j].fprint)
+				j = (j + 1) & (sz - 1);
+			slots[j] = set->slots[i];
+		}
+		free(set->slots);
+		set->slots = slots;
+		set->slotsz = sz;
+	}
+
+	mask = set->slotsz - 1;
+	for (i = d->fprinthash & mask; ; i = (i + 1) & mask) {
+		se = &set->slots[i];
+		if (NULL == se->fprint)
+			break;
+		if (se->hash == d->fprinthash &&
+		    se->fprintsz == d->fprintsz &&
+		    0 == memcmp(se->fprint, d->fprint, d->fprintsz))
+			return se;
+	}
+
+	if (NULL == (se->fprint = malloc(d->fprintsz + 1)))
+		err(EXIT_FAILURE, NULL);
+	memcpy(se->fprint, d->fprint, d->fprintsz);
+	se->fprint[d->fprintsz] = '\0';
+	se->fprintsz = d->fprintsz;
+	se->hash = d->fprinthash;
+	se->log = d->log;
+	se->line = d->line;
+	set->sz++;
+	return NULL;
+}
+
+/*
+ * Free the contents of "set", leaving it empty.
+ */
+void
+divecmd_fpset_free(struct fpset *set)
+{
+	size_t	 i;
+
+	for (i = 0; i < set->slotsz; i++)
+		free(set->slots[i].fprint);
+	free(set->slots);
+	set->slots = NULL;
+	set->slotsz = set->sz = 0;
+}
+
+/*
+ * Parse a "YYYY-MM-DD" date into the year, month, and day of "tm",
+ * leaving the rest of "tm" alone.
+ * Returns zero if malformed, non-zero on success.
+ */
+int
+divecmd_date_parse(const char *cp, struct tm *tm)
+{
+	int	 year, mon, mday;
+
+	if (NULL == (cp = dtnum(cp, &year)) || '-' != *cp++ ||
+	    NULL == (cp = dtnum(cp, &mon)) || '-' != *cp++ ||
+	    NULL == (cp = dtnum(cp, &mday)))
+		return 0;
+
+	tm->tm_year = year - 1900;
+	tm->tm_mon = mon - 1;
+	tm->tm_mday = mday;
+	return 1;
+}
+
+/*
+ * Parse a "HH:MM:SS" time into the hour, minute, and second of "tm",
+ * leaving the rest of "tm" alone.
+ * Returns zero if malformed, non-zero on success.
+ */
+int
+divecmd_time_parse(const char *cp, struct tm *tm)
+{
+	int	 hour, min, sec;
+
+	if (NULL == (cp = dtnum(cp, &hour)) || ':' != *cp++ ||
+	    NULL == (cp = dtnum(cp, &min)) || ':' != *cp++ ||
+	    NULL == (cp = dtnum(cp, &sec)))
+		return 0;
+
+	tm->tm_hour = hour;
+	tm->tm_min = min;
+	tm->tm_sec = sec;
+	return 1;
+}
+
+/*
+ * Like mktime(3) with a "tm_isdst" of -1, converting the local date and
+ * time in "tm" (which isn't modified) into an epoch.
+ * Days are converted once and kept in "c", so this only calls mktime(3)
+ * for new days, out-of-range fields, and days with DST transitions.
+ * Returns -1 on failure.
+ */
+time_t
+divecmd_mktime(struct dtcache *c, const struct tm *tm)
+{
+	const struct dtday *dd = NULL;
+	struct tm	 tmp;
+
+	if (tm->tm_mon >= 0 && tm->tm_mon < 12 &&
+	    tm->tm_mday > 0 && tm->tm_mday < 32 &&
+	    tm->tm_hour >= 0 && tm->tm_hour < 24 &&
+	    tm->tm_min >= 0 && tm->tm_min < 60 &&
+	    tm->tm_sec >= 0 && tm->tm_sec < 60)
+		dd = dtday_get(c, tm->tm_year, tm->tm_mon, tm->tm_mday);
+
+	if (NULL != dd)
+		return dd->start + tm->tm_hour * 60 * 60 + 
+			tm->tm_min * 60 + tm->tm_sec;
+
+	tmp = *tm;
+	tmp.tm_isdst = -1;
+	return mktime(&tmp);
+}
+
+/*
+ * Like localtime_r(3), converting "t" into the local date and time in
+ * "tm", but using and filling in the days in "c".
+ * Only the standard "struct tm" fields are set.
+ * If "t" can't be converted, "tm" is zeroed.
+ */
+void
+divecmd_localtime(struct dtcache *c, time_t t, struct tm *tm)
+{
+	const struct dtday *dd = &c->days[c->last];
+
+	if (0 == dd->mday || 0 == dd->plain ||
+	    t < dd->start || t - dd->start >= 60 * 60 * 24) {
+		if (NULL == localtime_r(&t, tm))
+			memset(tm, 0, sizeof(struct tm));
+		else
+			dtday_get(c, tm->tm_year, 
+				tm->tm_mon, tm->tm_mday);
+		return;
+	}
+
+	t -= dd->start;
+	memset(tm, 0, sizeof(struct tm));
+	tm->tm_year = dd->year;
+	tm->tm_mon = dd->mon;
+	tm->tm_mday = dd->mday;
+	tm->tm_wday = dd->wday;
+	tm->tm_yday = dd->yday;
+	tm->tm_isdst = dd->isdst;
+	tm->tm_hour = t / (60 * 60);
+	tm->tm_min = (t / 60) % 60;
+	tm->tm_sec = t % 60;
 }
 
 void
@@ -1398,23 +4370,12 @@ divecmd_free(struct diveq *dq, struct divestat *st)
 {
 	struct dive	*d;
 	struct dlog	*dl;
-	struct samp	*s;
 	size_t		 i;
 
 	if (NULL != dq)
 		while (NULL != (d = TAILQ_FIRST(dq))) {
 			TAILQ_REMOVE(dq, d, entries);
-			while (NULL != (s = TAILQ_FIRST(&d->samps))) {
-				TAILQ_REMOVE(&d->samps, s, entries);
-				free(s->vendor.buf);
-				free(s->events);
-				free(s->pressure);
-				free(s);
-			}
-			free(d->gas);
-			free(d->cyls);
-			free(d->fprint);
-			free(d);
+			dive_free(d);
 		}
 
 	if (NULL != st) {
@@ -1423,6 +4384,7 @@ divecmd_free(struct diveq *dq, struct divestat *st)
 			free(st->groups[i]);
 		}
 		free(st->groups);
+		free(st->groupmap);
 		while (NULL != (dl = TAILQ_FIRST(&st->dlogs))) {
 			TAILQ_REMOVE(&st->dlogs, dl, entries);
 			free(dl->file);
@@ -1436,9 +4398,18 @@ divecmd_free(struct diveq *dq, struct divestat *st)
 	}
 }
 
+/*
+ * Prepare "p", "dq", and "st" for parsing.
+ * Only the sample fields in "want", a mask of SAMP_xxx and WANT_xxx
+ * values (or WANT_ALL), are kept: others are still checked (so a file is
+ * accepted or rejected regardless of the mask), but not stored.
+ * They needn't contribute to the dive's aggregates: no cylinders are
+ * made from unwanted pressures, for example, unless read from a cache
+ * written with a wider mask.
+ */
 void
-divecmd_init(XML_Parser *p, struct diveq *dq, 
-	struct divestat *st, enum group group, enum groupsort sort)
+divecmd_init(XML_Parser *p, struct diveq *dq, struct divestat *st, 
+	enum group group, enum groupsort sort, unsigned int want)
 {
 
 	if (NULL == (*p = XML_ParserCreate(NULL)))
@@ -1448,6 +4419,7 @@ divecmd_init(XML_Parser *p, struct diveq *dq,
 	memset(st, 0, sizeof(struct divestat));
 	st->group = group;
 	st->groupsort = sort;
+	st->want = want;
 	TAILQ_INIT(&st->dlogs);
 }
 
@@ -1534,6 +4506,36 @@ divecmd_print_dive_sampleq(FILE *f, const struct sampq *q)
 	divecmd_print_dive_sampleq_close(f);
 }
 
+/*
+ * Print vendor data as hexadecimal, sixteen bytes per line, as is
+ * done by dcmd(1).
+ */
+static void
+print_vendor(FILE *f, const struct sampvendor *v)
+{
+	char	 line[6 + 32 + 1];
+	size_t	 i, j, k;
+
+	if (0 == v->bufsz) {
+		fprintf(f, "\t\t\t\t\t"
+			"<vendor type=\"%zu\" />\n", v->type);
+		return;
+	}
+
+	fprintf(f, "\t\t\t\t\t"
+		"<vendor type=\"%zu\">\n", v->type);
+	memset(line, '\t', 6);
+	for (i = 0; i < v->bufsz; ) {
+		for (j = 0, k = 6; i < v->bufsz && j < 16; j++, i++) {
+			line[k++] = hexdigs[v->buf[i] >> 4];
+			line[k++] = hexdigs[v->buf[i] & 0x0f];
+		}
+		line[k++] = '\n';
+		fwrite(line, 1, k, f);
+	}
+	fputs("\t\t\t\t\t</vendor>\n", f);
+}
+
 /*
  * Print the dive sample.
  */
@@ -1601,9 +4603,7 @@ divecmd_print_dive_sample(FILE *f, const struct samp *s)
 		}
 	}
 	if (SAMP_VENDOR & s->flags)
-		fprintf(f, "\t\t\t\t\t"
-			"<vendor type=\"%zu\">%s</vendor>\n",
-			s->vendor.type, s->vendor.buf);
+		print_vendor(f, &s->vendor);
 	if (SAMP_CNS & s->flags)
 		fprintf(f, "\t\t\t\t\t"
 			"<cns value=\"%.2f\" />\n", s->cns);
@@ -1681,7 +4681,8 @@ divecmd_print_dive(FILE *f, const struct dive *d)
 void
 divecmd_print_dive_open(FILE *f, const struct dive *d)
 {
-	struct tm	*tm;
+	static struct dtcache dc; /* not reentrant, like localtime(3) */
+	struct tm	 tm;
 
 	fputs("\t\t<dive", f);
 
@@ -1689,12 +4690,12 @@ divecmd_print_dive_open(FILE *f, const struct dive *d)
 		fprintf(f, " number=\"%zu\"", d->num);
 
 	if (d->datetime) {
-		tm = localtime(&d->datetime);
+		divecmd_localtime(&dc, d->datetime, &tm);
 		fprintf(f, " date=\"%04d-%02d-%02d\""
 		           " time=\"%02d:%02d:%02d\"",
-			tm->tm_year + 1900, 
-			tm->tm_mon + 1, tm->tm_mday, 
-			tm->tm_hour, tm->tm_min, tm->tm_sec);
+			tm.tm_year + 1900, 
+			tm.tm_mon + 1, tm.tm_mday, 
+			tm.tm_hour, tm.tm_min, tm.tm_sec);
 	}
 
 	if (MODE_FREEDIVE == d->mode)
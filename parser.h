@@ -95,6 +95,72 @@ enum	deco {
 	DECO__MAX
 };
 
+/*
+ * Element and attribute names recognised by the divecmd (and
+ * Subsurface) XML parsers.
+ * See divecmd_token().
+ */
+enum	token {
+	TOKEN__NONE, /* not a known name */
+	TOKEN_cns,
+	TOKEN_cylinder,
+	TOKEN_date,
+	TOKEN_dctype,
+	TOKEN_deco,
+	TOKEN_depth,
+	TOKEN_description,
+	TOKEN_dive,
+	TOKEN_divecomputer,
+	TOKEN_divecomputerid,
+	TOKEN_diveid,
+	TOKEN_divelog,
+	TOKEN_diver,
+	TOKEN_dives,
+	TOKEN_divesites,
+	TOKEN_duration,
+	TOKEN_event,
+	TOKEN_extradata,
+	TOKEN_fingerprint,
+	TOKEN_flags,
+	TOKEN_gaschange,
+	TOKEN_gasmix,
+	TOKEN_gasmixes,
+	TOKEN_he,
+	TOKEN_in_deco,
+	TOKEN_mix,
+	TOKEN_mode,
+	TOKEN_model,
+	TOKEN_n2,
+	TOKEN_ndl,
+	TOKEN_num,
+	TOKEN_number,
+	TOKEN_o2,
+	TOKEN_pressure,
+	TOKEN_product,
+	TOKEN_program,
+	TOKEN_rbt,
+	TOKEN_sample,
+	TOKEN_samples,
+	TOKEN_settings,
+	TOKEN_size,
+	TOKEN_stopdepth,
+	TOKEN_stoptime,
+	TOKEN_surface,
+	TOKEN_tank,
+	TOKEN_tanks,
+	TOKEN_temp,
+	TOKEN_temperature,
+	TOKEN_time,
+	TOKEN_type,
+	TOKEN_value,
+	TOKEN_vendor,
+	TOKEN_version,
+	TOKEN_volume,
+	TOKEN_water,
+	TOKEN_workpressure,
+	TOKEN__MAX
+};
+
 struct	sampevent {
 	size_t	  	 duration; /* duration (or zero) */
 	unsigned int	 flags; /* any opaque flags (or zero) */
@@ -118,7 +184,8 @@ struct	sampdeco {
  * Vendor-specific information (can be anything).
  */
 struct	sampvendor {
-	char		*buf; /* hex-valued vendor information */
+	unsigned char	*buf; /* vendor information or NULL */
+	size_t		 bufsz; /* bytes in "buf" */
 	size_t		 type; /* opaque type */
 };
 
@@ -155,11 +222,17 @@ struct	samp {
 #define	SAMP_DEPTH	  0x01 /* sets depth */
 #define	SAMP_TEMP	  0x02 /* sets tmp */
 #define	SAMP_RBT	  0x04 /* sets rbt */
+#define	SAMP_EXTRA	  0x08 /* see struct sampcols */
 #define	SAMP_DECO	  0x10 /* sets deco */
 #define	SAMP_VENDOR	  0x20 /* sets vendor */
 #define	SAMP_GASCHANGE	  0x40 /* sets gaschange */
 #define	SAMP_CNS	  0x80 /* sets cns */
 	unsigned int	  flags; /* SAMP_xxx values represented */
+#define	WANT_PRESSURE	  0x100 /* parse pressures */
+#define	WANT_EVENTS	  0x200 /* parse events */
+#define	WANT_ALL	 (SAMP_DEPTH | SAMP_TEMP | SAMP_RBT | \
+			  SAMP_DECO | SAMP_VENDOR | SAMP_GASCHANGE | \
+			  SAMP_CNS | WANT_PRESSURE | WANT_EVENTS)
 	size_t		  line; /* parse line */
 	size_t		  col; /* parse column */
 	TAILQ_ENTRY(samp) entries;
@@ -167,6 +240,26 @@ struct	samp {
 
 TAILQ_HEAD(sampq, samp);
 
+/*
+ * Columnar copy of a dive's time, depth, temperature, and CNS samples,
+ * in sample order.
+ * The "flags" array holds each sample's SAMP_xxx values: the columns
+ * for a given sample are only meaningful if the corresponding flag is
+ * set (time is always set).
+ * This is filled in by divecmd_parse() when the dive is closed.
+ * In compact parses, it's the only record of most samples: SAMP_EXTRA
+ * marks those that also have a "struct samp", in order, in the dive's
+ * "samps" for fields not in the columns.
+ */
+struct	sampcols {
+	size_t		 *time; /* seconds since start */
+	double		 *depth; /* metres */
+	double		 *temp; /* celsius */
+	double		 *cns; /* [0,1] */
+	unsigned char	 *flags; /* SAMP_xxx values represented */
+	size_t		  sz; /* number of samples */
+};
+
 struct	dive;
 
 TAILQ_HEAD(diveq, dive);
@@ -177,6 +270,9 @@ struct	dgroup {
 	size_t		  id; /* unique identifier */
 	size_t		  ndives; /* number of dives in queue */
 	struct diveq	  dives; /* all dives */
+	unsigned int	  hash; /* hash of lookup key */
+	const struct dlog *log; /* divelog of first dive */
+	double		  keymin; /* least non-zero dive key (or zero) */
 };
 
 /*
@@ -210,13 +306,21 @@ struct	cylinder {
 	double		 workpressure; /* working pressure (bar) or zero */
 };
 
+/*
+ * Chunks of memory from which all of a dive's samples and sample data
+ * (pressures, events, vendor data) are bump-allocated.
+ * These are released all at once when the dive is freed.
+ */
+struct	dchunk;
+
 struct	dive {
 	size_t		     pid; /* unique in parse sequence */
 	time_t		     datetime; /* time or zero */
 	size_t		     num; /* number or zero */
 	size_t		     duration; /* duration or zero */
 	enum mode	     mode; /* dive mode */
-	struct sampq	     samps; /* samples */
+	struct sampq	     samps; /* samples (see struct sampcols) */
+	struct sampcols	     cols; /* columnar samples */
 	struct divegas	    *gas; /* gasmixes */
 	size_t		     gassz; /* number of gasses */
 	struct cylinder	    *cyls; /* cylinders ("tanks") */
@@ -225,15 +329,84 @@ struct	dive {
 	int		     hastemp; /* do we have temps? */
 	double		     maxtemp; /* maximum (hottest) temp */
 	double		     mintemp; /* minimum (coldest) temp */
+	double		     sumtemp; /* sum of all temps */
+	size_t		     ntemps; /* number of temps */
 	size_t		     maxtime; /* maximum sample time */
 	size_t		     nsamps; /* number of samples */
 	char		    *fprint; /* fingerprint or NULL */
+	size_t		     fprintsz; /* length of fprint */
+	uint64_t	     fprinthash; /* hash of fprint */
 	struct dgroup 	    *group; /* group identifier */
+	double		     gkey; /* key in group (unless by date) */
 	const struct dlog   *log; /* source divelog */
 	TAILQ_ENTRY(dive)    entries; /* in-dive entry */
 	TAILQ_ENTRY(dive)    gentries; /* in-group entry */
 	size_t		     line; /* parse line */
 	size_t		     col; /* parse column */
+	struct dchunk	    *arena; /* sample memory */
+};
+
+/*
+ * What's known of a dive before it's parsed, such as from a sidecar
+ * index.
+ * See divecmd_parse_select().
+ */
+struct	dindex {
+	size_t		 pid; /* unique in parse sequence */
+	time_t		 datetime; /* time or zero */
+	size_t		 duration; /* duration or zero */
+	enum mode	 mode; /* dive mode */
+	double		 maxdepth; /* maximum sample depth */
+	const char	*fprint; /* fingerprint or NULL */
+};
+
+/*
+ * A fingerprint in a "struct fpset".
+ */
+struct	fpseen {
+	uint64_t	   hash; /* see "struct dive" */
+	char		  *fprint; /* copy of fingerprint or NULL if free */
+	size_t		   fprintsz; /* length of "fprint" */
+	const struct dlog *log; /* divelog of the dive */
+	size_t		   line; /* parse line of the dive */
+};
+
+/*
+ * Set of fingerprints used for finding duplicate dives.
+ * It's empty when zeroed.
+ * See divecmd_fpset_add().
+ */
+struct	fpset {
+	struct fpseen	*slots; /* open-addressed table */
+	size_t		 slotsz; /* zero or power of two */
+	size_t		 sz; /* occupied slots */
+};
+
+/*
+ * A local calendar day, for converting between local dates and epochs
+ * without mktime(3) and localtime(3) on every call.
+ */
+struct	dtday {
+	int		 year; /* as in "struct tm" */
+	int		 mon; /* as in "struct tm" */
+	int		 mday; /* as in "struct tm" (zero if unset) */
+	int		 wday; /* as in "struct tm" */
+	int		 yday; /* as in "struct tm" */
+	int		 isdst; /* as in "struct tm" */
+	int		 plain; /* 24 hours with one UTC offset */
+	time_t		 start; /* epoch of local midnight */
+};
+
+#define	DTCACHE_SZ	 64
+
+/*
+ * Days recently converted by divecmd_mktime() and divecmd_localtime().
+ * It's empty when zeroed.
+ * Each thread must use its own.
+ */
+struct	dtcache {
+	struct dtday	 days[DTCACHE_SZ]; /* hashed by date */
+	size_t		 last; /* last day looked up */
 };
 
 struct	divestat {
@@ -242,18 +415,44 @@ struct	divestat {
 	time_t		  timestamp_max; /* maximum timestamp */
 	enum group	  group; /* how we're grouping dives */
 	enum groupsort	  groupsort; /* how we're sorting dives */
+	int		  summary; /* see divecmd_parse() */
+	unsigned int	  want; /* see divecmd_init() */
+	int		  compact; /* see divecmd_parse() */
 	struct dgroup	**groups; /* all groups */
 	size_t		  groupsz; /* size of "groups" */
+	struct dgroup	**groupmap; /* groups hashed by key */
+	size_t		  groupmapsz; /* slots in "groupmap" */
 	struct dlogq	  dlogs; /* all divelog nodes */
 };
 
 __BEGIN_DECLS
 
 void	 divecmd_init(XML_Parser *, struct diveq *, 
-		struct divestat *, enum group, enum groupsort);
+		struct divestat *, enum group, enum groupsort,
+		unsigned int);
+enum token divecmd_token(const char *);
+void	*divecmd_arena_calloc(struct dive *, size_t, size_t);
+void	*divecmd_arena_reallocarray(struct dive *, 
+		void *, size_t, size_t, size_t);
+int	 divecmd_feed(XML_Parser, int, const char *);
+double	 divecmd_strtod(const char *, char **);
 void	 divecmd_free(struct diveq *, struct divestat *);
+const struct fpseen *divecmd_fpset_add(struct fpset *, const struct dive *);
+int	 divecmd_date_parse(const char *, struct tm *);
+void	 divecmd_localtime(struct dtcache *, time_t, struct tm *);
+time_t	 divecmd_mktime(struct dtcache *, const struct tm *);
+int	 divecmd_time_parse(const char *, struct tm *);
+void	 divecmd_fpset_free(struct fpset *);
 int	 divecmd_parse(const char *, XML_Parser, 
 		struct diveq *dq, struct divestat *);
+int	 divecmd_parse_many(const char *const *, size_t,
+		struct diveq *, struct divestat *);
+int	 divecmd_parse_select(const char *const *, size_t,
+		struct diveq *, struct divestat *,
+		int (*)(const struct dindex *, void *), void *);
+int	 divecmd_parse_stream(const char *, XML_Parser,
+		struct diveq *, struct divestat *,
+		int (*)(struct dive *, void *), void *);
 
 void	 divecmd_print_diveq_close(FILE *);
 void	 divecmd_print_diveq_open(FILE *);
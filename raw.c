@@ -0,0 +1,333 @@
+/*	$Id$ */
+/*
+ * Copyright (C) 2016 Kristaps Dzonsons, kristaps@bsd.lv
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+#include "config.h"
+
+#include <sys/stat.h>
+
+#include <ctype.h>
+#include <dirent.h>
+#if HAVE_ERR
+# include <err.h>
+#endif
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "extern.h"
+
+/*
+ * Each stored dive is a file DIR/FINGERPRINT.bin, where FINGERPRINT is
+ * the upper-case hexadecimal dive fingerprint.
+ * The file is a fixed header followed by the raw dive as given to us
+ * by the device.
+ * All header integers are little-endian.
+ */
+#define	RAW_MAGIC	"DCMDRAW1"
+#define	RAW_MAGICSZ	8
+#define	RAW_HEADSZ	32 /* magic, session, index, devtime, systime */
+
+static void
+put32(unsigned char *p, unsigned long long v)
+{
+	size_t	 i;
+
+	for (i = 0; i < 4; i++)
+		p[i] = (v >> (i * 8)) & 0xff;
+}
+
+static void
+put64(unsigned char *p, unsigned long long v)
+{
+	size_t	 i;
+
+	for (i = 0; i < 8; i++)
+		p[i] = (v >> (i * 8)) & 0xff;
+}
+
+static unsigned long long
+get32(const unsigned char *p)
+{
+	unsigned long long v = 0;
+	size_t	 i;
+
+	for (i = 0; i < 4; i++)
+		v |= (unsigned long long)p[i] << (i * 8);
+	return v;
+}
+
+static unsigned long long
+get64(const unsigned char *p)
+{
+	unsigned long long v = 0;
+	size_t	 i;
+
+	for (i = 0; i < 8; i++)
+		v |= (unsigned long long)p[i] << (i * 8);
+	return v;
+}
+
+/*
+ * Write a dive into the store "dir", replacing any existing dive with
+ * the same fingerprint.
+ * The dive is written to a temporary file that's renamed into place,
+ * so an interrupted download never leaves a partial dive.
+ * Exits on failure.
+ */
+void
+raw_write(const char *dir, const struct dcmd_raw *raw,
+	const unsigned char *data, unsigned int size)
+{
+	unsigned char	 head[RAW_HEADSZ];
+	char		*tmp, *file;
+	int		 fd;
+	ssize_t		 ssz;
+	size_t		 off, sz;
+
+	memcpy(head, RAW_MAGIC, RAW_MAGICSZ);
+	put64(head + 8, (unsigned long long)raw->session);
+	put32(head + 16, raw->index);
+	put32(head + 20, raw->devtime);
+	put64(head + 24, (unsigned long long)raw->systime);
+
+	if (asprintf(&tmp, "%s/.dive.XXXXXXXXXX", dir) < 0)
+		err(EXIT_FAILURE, NULL);
+	if (asprintf(&file, "%s/%s.bin", dir, raw->fpbuf) < 0)
+		err(EXIT_FAILURE, NULL);
+	if (-1 == (fd = mkstemp(tmp)))
+		err(EXIT_FAILURE, "%s", tmp);
+
+	for (off = 0; off < RAW_HEADSZ + (size_t)size; off += ssz) {
+		if (off < RAW_HEADSZ) {
+			sz = RAW_HEADSZ - off;
+			ssz = write(fd, head + off, sz);
+		} else {
+			sz = RAW_HEADSZ + (size_t)size - off;
+			ssz = write(fd, data + (off - RAW_HEADSZ), sz);
+		}
+		if (-1 == ssz) {
+			unlink(tmp);
+			err(EXIT_FAILURE, "%s", tmp);
+		}
+	}
+
+	if (-1 == close(fd)) {
+		unlink(tmp);
+		err(EXIT_FAILURE, "%s", tmp);
+	} else if (-1 == rename(tmp, file)) {
+		unlink(tmp);
+		err(EXIT_FAILURE, "%s", file);
+	}
+
+	if (verbose > 1)
+		fprintf(stderr, "%s: stored\n", file);
+
+	free(tmp);
+	free(file);
+}
+
+/*
+ * Newest dives first, as if downloaded from the device.
+ * That's the most recent session first and, within a session, the
+ * device's own order.
+ */
+static int
+raw_cmp(const void *p1, const void *p2)
+{
+	const struct dcmd_raw *r1 = p1, *r2 = p2;
+
+	if (r1->session != r2->session)
+		return r1->session > r2->session ? -1 : 1;
+	if (r1->index != r2->index)
+		return r1->index < r2->index ? -1 : 1;
+	return strcmp(r1->fpbuf, r2->fpbuf);
+}
+
+/*
+ * Read the header of a stored dive "name" in "dir" into "raw".
+ * Returns zero if the file isn't a stored dive (it's skipped), non-zero
+ * on success.
+ */
+static int
+raw_head(const char *dir, const char *name, struct dcmd_raw *raw)
+{
+	unsigned char	 head[RAW_HEADSZ];
+	const char	*cp;
+	size_t		 sz;
+	ssize_t		 ssz;
+	int		 fd;
+	struct stat	 st;
+
+	memset(raw, 0, sizeof(struct dcmd_raw));
+
+	/* Only FINGERPRINT.bin: skip everything else. */
+
+	if (NULL == (cp = strrchr(name, '.')) || strcmp(cp, ".bin"))
+		return 0;
+	sz = cp - name;
+	if (0 == sz || sz % 2)
+		return 0;
+	for (cp = name; cp < name + sz; cp++)
+		if ( ! isxdigit((unsigned char)*cp))
+			return 0;
+
+	if (asprintf(&raw->file, "%s/%s", dir, name) < 0)
+		err(EXIT_FAILURE, NULL);
+	if (NULL == (raw->fpbuf = strndup(name, sz)))
+		err(EXIT_FAILURE, NULL);
+
+	if (-1 == (fd = open(raw->file, O_RDONLY, 0))) {
+		warn("%s", raw->file);
+		goto bad;
+	} else if (-1 == fstat(fd, &st)) {
+		warn("%s", raw->file);
+		close(fd);
+		goto bad;
+	} else if (st.st_size < RAW_HEADSZ ||
+		   st.st_size - RAW_HEADSZ > UINT_MAX) {
+		warnx("%s: bad size", raw->file);
+		close(fd);
+		goto bad;
+	} else if (RAW_HEADSZ != (ssz = read(fd, head, RAW_HEADSZ))) {
+		if (-1 == ssz)
+			warn("%s", raw->file);
+		else
+			warnx("%s: short read", raw->file);
+		close(fd);
+		goto bad;
+	}
+	close(fd);
+
+	if (memcmp(head, RAW_MAGIC, RAW_MAGICSZ)) {
+		warnx("%s: not a stored dive", raw->file);
+		goto bad;
+	}
+
+	raw->session = (dc_ticks_t)get64(head + 8);
+	raw->index = get32(head + 16);
+	raw->devtime = get32(head + 20);
+	raw->systime = (dc_ticks_t)get64(head + 24);
+	raw->size = st.st_size - RAW_HEADSZ;
+	return 1;
+bad:
+	free(raw->file);
+	free(raw->fpbuf);
+	return 0;
+}
+
+/*
+ * Scan the store "dir" for all stored dives, sorted newest first.
+ * Only the headers are read: use raw_read() for each dive.
+ * Returns NULL on failure (the directory can't be read) and sets "sz"
+ * to the number of dives.
+ */
+struct dcmd_raw *
+raw_scan(const char *dir, size_t *sz)
+{
+	DIR		*dirp;
+	struct dirent	*dp;
+	struct dcmd_raw	*raws = NULL, *rp;
+	size_t		 max = 0;
+
+	*sz = 0;
+
+	if (NULL == (dirp = opendir(dir))) {
+		warn("%s", dir);
+		return NULL;
+	}
+
+	while (NULL != (dp = readdir(dirp))) {
+		if (*sz == max) {
+			max = 0 == max ? 64 : max * 2;
+			rp = reallocarray(raws, max, sizeof(struct dcmd_raw));
+			if (NULL == rp)
+				err(EXIT_FAILURE, NULL);
+			raws = rp;
+		}
+		if (raw_head(dir, dp->d_name, &raws[*sz]))
+			(*sz)++;
+	}
+
+	closedir(dirp);
+
+	if (NULL == raws && NULL == (raws = calloc(1, 1)))
+		err(EXIT_FAILURE, NULL);
+
+	qsort(raws, *sz, sizeof(struct dcmd_raw), raw_cmp);
+	return raws;
+}
+
+/*
+ * Read the dive data of a stored dive from raw_scan().
+ * Returns NULL on failure (the dive should be skipped).
+ */
+unsigned char *
+raw_read(const struct dcmd_raw *raw)
+{
+	unsigned char	*data;
+	int		 fd;
+	ssize_t		 ssz;
+	size_t		 off;
+
+	if (NULL == (data = malloc(raw->size > 0 ? raw->size : 1)))
+		err(EXIT_FAILURE, NULL);
+
+	if (-1 == (fd = open(raw->file, O_RDONLY, 0))) {
+		warn("%s", raw->file);
+		free(data);
+		return NULL;
+	} else if (-1 == lseek(fd, RAW_HEADSZ, SEEK_SET)) {
+		warn("%s", raw->file);
+		goto bad;
+	}
+
+	for (off = 0; off < raw->size; off += ssz)
+		if (-1 == (ssz = read(fd, data + off, raw->size - off))) {
+			warn("%s", raw->file);
+			goto bad;
+		} else if (0 == ssz) {
+			warnx("%s: short read", raw->file);
+			goto bad;
+		}
+
+	close(fd);
+	return data;
+bad:
+	close(fd);
+	free(data);
+	return NULL;
+}
+
+void
+raw_free(struct dcmd_raw *raws, size_t sz)
+{
+	size_t	 i;
+
+	if (NULL == raws)
+		return;
+	for (i = 0; i < sz; i++) {
+		free(raws[i].file);
+		free(raws[i].fpbuf);
+	}
+	free(raws);
+}
@@ -0,0 +1,206 @@
+/*	$Id$ */
+/*
+ * Copyright (C) 2016 Kristaps Dzonsons, kristaps@bsd.lv
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+#include "config.h"
+
+#include <ctype.h>
+#if HAVE_ERR
+# include <err.h>
+#endif
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "extern.h"
+
+/*
+ * A replay "device" plays back a raw store (see raw.c) recorded with
+ * "dcmd -k", handing its dives to the download callbacks as a device
+ * would: newest first, stopping at the last-seen fingerprint, with
+ * clock and progress events.
+ * Its name is "replay:PATH" or "replay@RATE:PATH", where PATH is the
+ * store directory and RATE a simulated transfer rate in bytes per
+ * second (otherwise as fast as possible).
+ */
+
+int
+replay_isdev(const char *devname)
+{
+
+	return 0 == strncmp(devname, "replay:", 7) ||
+	       0 == strncmp(devname, "replay@", 7);
+}
+
+/*
+ * Sleep as long as it would take to transfer "sz" bytes at "rate"
+ * bytes per second.
+ */
+static void
+replay_wait(size_t sz, unsigned long long rate)
+{
+	struct timespec	 ts;
+	unsigned long long ns;
+
+	if (0 == rate)
+		return;
+
+	ns = (unsigned long long)sz * 1000000000ULL / rate;
+	ts.tv_sec = ns / 1000000000ULL;
+	ts.tv_nsec = ns % 1000000000ULL;
+
+	while (-1 == nanosleep(&ts, &ts))
+		if (EINTR != errno)
+			err(EXIT_FAILURE, "nanosleep");
+		else if (dctool_cancel_cb(NULL))
+			break;
+}
+
+static unsigned char
+replay_nibble(char c)
+{
+
+	if (isdigit((unsigned char)c))
+		return c - '0';
+	return toupper((unsigned char)c) - 'A' + 10;
+}
+
+/*
+ * Convert the hexadecimal fingerprint "hex" (as checked by raw_scan())
+ * into "buf", which must be at least half the string length.
+ * Returns the number of bytes.
+ */
+static unsigned int
+replay_fprint(const char *hex, unsigned char *buf)
+{
+	unsigned int	 i;
+
+	for (i = 0; '\0' != hex[i * 2]; i++)
+		buf[i] = replay_nibble(hex[i * 2]) << 4 | 
+			replay_nibble(hex[i * 2 + 1]);
+
+	return i;
+}
+
+/*
+ * Play back the store named by "devname" (see replay_isdev()) through
+ * "cb", like dc_device_foreach().
+ * Clock and progress events go to "evcb", both with "arg".
+ * If "fprint" is set, stop at (without passing) that dive.
+ */
+dc_status_t
+replay_foreach(const char *devname, dc_buffer_t *fprint,
+	dc_event_callback_t evcb, dc_dive_callback_t cb, void *arg)
+{
+	struct dcmd_raw		*raws;
+	dc_event_clock_t	 clock;
+	dc_event_progress_t	 progress;
+	unsigned char		*data, *fpr = NULL;
+	unsigned long long	 rate = 0;
+	const char		*path, *er;
+	char			*cp = NULL;
+	size_t			 i, sz, total = 0, done = 0;
+	unsigned int		 fprsz = 0;
+	dc_status_t		 rc = DC_STATUS_SUCCESS;
+
+	/* Parse the rate, if any, and path. */
+
+	if ('@' == devname[6]) {
+		if (NULL == (path = strchr(devname + 7, ':'))) {
+			warnx("%s: expected replay@RATE:PATH", devname);
+			return DC_STATUS_INVALIDARGS;
+		}
+		if (NULL == (cp = strndup
+		    (devname + 7, path - (devname + 7))))
+			err(EXIT_FAILURE, NULL);
+		rate = strtonum(cp, 1, LLONG_MAX, &er);
+		if (NULL != er) {
+			warnx("%s: rate %s", devname, er);
+			free(cp);
+			return DC_STATUS_INVALIDARGS;
+		}
+		free(cp);
+		path++;
+	} else
+		path = devname + 7;
+
+	if (NULL == (raws = raw_scan(path, &sz)))
+		return DC_STATUS_NODEVICE;
+
+	for (i = 0; i < sz; i++) {
+		total += raws[i].size;
+		if (NULL == fpr || strlen(raws[i].fpbuf) / 2 > fprsz) {
+			fprsz = strlen(raws[i].fpbuf) / 2;
+			free(fpr);
+			if (NULL == (fpr = malloc(fprsz)))
+				err(EXIT_FAILURE, NULL);
+		}
+	}
+
+	memset(&clock, 0, sizeof(dc_event_clock_t));
+	memset(&progress, 0, sizeof(dc_event_progress_t));
+	progress.maximum = total;
+
+	for (i = 0; i < sz; i++) {
+		if (dctool_cancel_cb(NULL)) {
+			rc = DC_STATUS_CANCELLED;
+			break;
+		}
+
+		/* Like a device, stop at the last-seen dive. */
+
+		fprsz = replay_fprint(raws[i].fpbuf, fpr);
+		if (NULL != fprint &&
+		    dc_buffer_get_size(fprint) == fprsz &&
+		    0 == memcmp(dc_buffer_get_data(fprint), fpr, fprsz))
+			break;
+
+		/* Dives from other downloads may have other clocks. */
+
+		if (0 == i ||
+		    clock.devtime != raws[i].devtime ||
+		    clock.systime != raws[i].systime) {
+			clock.devtime = raws[i].devtime;
+			clock.systime = raws[i].systime;
+			evcb(NULL, DC_EVENT_CLOCK, &clock, arg);
+		}
+
+		if (NULL == (data = raw_read(&raws[i]))) {
+			rc = DC_STATUS_IO;
+			break;
+		}
+
+		replay_wait(raws[i].size, rate);
+		done += raws[i].size;
+		progress.current = done;
+		evcb(NULL, DC_EVENT_PROGRESS, &progress, arg);
+
+		if ( ! cb(data, raws[i].size, fpr, fprsz, arg)) {
+			free(data);
+			break;
+		}
+		free(data);
+	}
+
+	raw_free(raws, sz);
+	free(fpr);
+	return rc;
+}
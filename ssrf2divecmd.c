@@ -27,6 +27,7 @@
 #include <float.h>
 #include <limits.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -51,6 +52,7 @@ struct	parse {
 	size_t		  igndepth; /* nested ignore scopes */
 	size_t		  pid; /* current dive no. */
 	int		  in_deco; /* are we in deco? */
+	struct dtcache	  dates_tz; /* <dive> date conversion */
 };
 
 static void
@@ -217,7 +219,8 @@ samp_alloc(struct parse *p, size_t tm)
 	ss = TAILQ_LAST(&p->curdive->samps, sampq);
 
 	if (NULL != ss && ss->time < tm) {
-		samp = xcalloc(p, 1, sizeof(struct samp));
+		samp = divecmd_arena_calloc
+			(p->curdive, 1, sizeof(struct samp));
 		samp->time = tm;
 		TAILQ_INSERT_TAIL(&p->curdive->samps, samp, entries);
 		p->curdive->nsamps++;
@@ -231,7 +234,8 @@ samp_alloc(struct parse *p, size_t tm)
 		else if (ss->time > tm)
 			break;
 
-	samp = xcalloc(p, 1, sizeof(struct samp));
+	samp = divecmd_arena_calloc
+		(p->curdive, 1, sizeof(struct samp));
 	samp->time = tm;
 
 	if (NULL != ss)
@@ -293,6 +297,26 @@ group_alloc(struct parse *p, struct dive *d, const char *date)
 	return group_add(p, i, d);
 }
 
+/*
+ * Parse a number followed by the unit suffix "unit", e.g., "xx m".
+ * Returns zero if the suffix is missing, <0 if the number is malformed,
+ * and >0 on success (setting "res").
+ */
+static int
+parse_unit(const char *v, const char *unit, double *res)
+{
+	size_t	 sz, usz = strlen(unit);
+	char	*ep;
+
+	if ((sz = strlen(v)) < usz)
+		return 0;
+	if (strcmp(unit, &v[sz - usz]))
+		return 0;
+
+	*res = divecmd_strtod(v, &ep);
+	return ep == v || ep > &v[sz - usz] ? -1 : 1;
+}
+
 /*
  * Parse depth in degrees celsius, "xx C".
  * Returns <0 on failure.
@@ -300,21 +324,12 @@ group_alloc(struct parse *p, struct dive *d, const char *date)
 static double
 parse_temp(struct parse *p, const char *v)
 {
-	size_t	 sz;
-	char	*cp;
-	int	 rc;
 	double	 val;
+	int	 rc;
 
-	if ((sz = strlen(v)) < 2)
-		return 0;
-	if (strcmp(" C", &v[sz - 2]))
-		return 0;
-
-	cp = xstrndup(p, v, sz - 2);
-	rc = sscanf(cp, "%lg", &val);
-	free(cp);
-
-	return 1 != rc ? -1.0 : val;
+	if ((rc = parse_unit(v, " C", &val)) <= 0)
+		return 0 == rc ? 0 : -1.0;
+	return val;
 }
 
 /*
@@ -326,23 +341,11 @@ parse_temp(struct parse *p, const char *v)
 static int
 parse_pressure(struct parse *p, const char *v, double *res)
 {
-	size_t	 sz;
-	char	*cp;
-	int	 rc;
 	double	 val;
 
 	*res = -1.0;
 
-	if ((sz = strlen(v)) < 4)
-		return 0;
-	if (strcmp(" bar", &v[sz - 4]))
-		return 0;
-
-	cp = xstrndup(p, v, sz - 4);
-	rc = sscanf(cp, "%lg", &val);
-	free(cp);
-
-	if (1 != rc || val < 0.0)
+	if (parse_unit(v, " bar", &val) <= 0 || val < 0.0)
 		return 0;
 	if (val <= FLT_EPSILON)
 		val = 0.0;
@@ -358,21 +361,12 @@ parse_pressure(struct parse *p, const char *v, double *res)
 static double
 parse_volume(struct parse *p, const char *v)
 {
-	size_t	 sz;
-	char	*cp;
-	int	 rc;
 	double	 val;
+	int	 rc;
 
-	if ((sz = strlen(v)) < 2)
-		return 0;
-	if (strcmp(" l", &v[sz - 2]))
-		return 0;
-
-	cp = xstrndup(p, v, sz - 2);
-	rc = sscanf(cp, "%lg", &val);
-	free(cp);
-
-	return 1 != rc ? -1.0 : val;
+	if ((rc = parse_unit(v, " l", &val)) <= 0)
+		return 0 == rc ? 0 : -1.0;
+	return val;
 }
 
 /*
@@ -382,21 +376,12 @@ parse_volume(struct parse *p, const char *v)
 static double
 parse_depth(struct parse *p, const char *v)
 {
-	size_t	 sz;
-	char	*cp;
-	int	 rc;
 	double	 val;
+	int	 rc;
 
-	if ((sz = strlen(v)) < 2)
-		return 0;
-	if (strcmp(" m", &v[sz - 2]))
-		return 0;
-
-	cp = xstrndup(p, v, sz - 2);
-	rc = sscanf(cp, "%lg", &val);
-	free(cp);
-
-	return 1 != rc ? -1.0 : val;
+	if ((rc = parse_unit(v, " m", &val)) <= 0)
+		return 0 == rc ? 0 : -1.0;
+	return val;
 }
 
 /*
@@ -468,28 +453,16 @@ parse_percent(const char *val, double *res)
  * Returns the epoch stamp or <0 on failure.
  */
 static time_t
-parse_date(const char *date, const char *time)
+parse_date(struct parse *p, const char *date, const char *time)
 {
 	struct tm	 tm;
-	int		 rc;
 
 	memset(&tm, 0, sizeof(struct tm));
-	rc = sscanf(date, "%d-%d-%d", 
-		&tm.tm_year, &tm.tm_mon, &tm.tm_mday);
-	if (3 != rc)
+	if ( ! divecmd_date_parse(date, &tm) ||
+	    ! divecmd_time_parse(time, &tm))
 		return -1;
 
-	tm.tm_year -= 1900;
-	tm.tm_mon -= 1;
-
-	rc = sscanf(time, "%d:%d:%d", 
-		&tm.tm_hour, &tm.tm_min, &tm.tm_sec);
-	if (3 != rc)
-		return -1;
-
-	tm.tm_isdst = -1;
-
-	return mktime(&tm);
+	return divecmd_mktime(&p->dates_tz, &tm);
 }
 
 /*
@@ -513,7 +486,7 @@ parse_divecomputerid(struct parse *p, const XML_Char **atts)
 	}
 
 	for (ap = atts; NULL != ap[0]; ap += 2)
-		if (0 == strcmp(ap[0], "model")) {
+		if (TOKEN_model == divecmd_token(ap[0])) {
 			pmodel = ap[1];
 			break;
 		}
@@ -554,15 +527,16 @@ parse_event(struct parse *p, const XML_Char **atts)
 	size_t		  tm;
 	const XML_Char	**ap;
 	const char	 *typep = NULL, *tmp = NULL, *flagp = NULL;
+	enum token	  tok;
 	
 	/* All events must have a time and type. */
 
 	for (ap = atts; NULL != ap[0]; ap += 2) 
-		if (0 == strcmp(*ap, "type")) 
+		if (TOKEN_type == (tok = divecmd_token(*ap))) 
 			typep = ap[1];
-		else if (0 == strcmp(*ap, "time"))
+		else if (TOKEN_time == tok)
 			tmp = ap[1];
-		else if (0 == strcmp(*ap, "flags"))
+		else if (TOKEN_flags == tok)
 			flagp = ap[1];
 
 	if (NULL == typep) {
@@ -585,11 +559,9 @@ parse_event(struct parse *p, const XML_Char **atts)
 	/* Each is going to be a singleton. */
 
 	samp = samp_alloc(p, tm);
-	samp->events = xreallocarray
-		(p, samp->events, samp->eventsz + 1, 
-		 sizeof(struct sampevent));
-	memset(&samp->events[samp->eventsz], 
-		0, sizeof(struct sampevent));
+	samp->events = divecmd_arena_reallocarray
+		(p->curdive, samp->events, samp->eventsz, 
+		 samp->eventsz + 1, sizeof(struct sampevent));
 	samp->events[samp->eventsz].type = type;
 	if (NULL != flagp) 
 		samp->events[samp->eventsz].flags = atoi(flagp);
@@ -604,9 +576,10 @@ parse_sample(struct parse *p, const XML_Char **atts)
 	struct dive	 *d = p->curdive;
 	const char	 *v;
 	size_t		  i, sz, tm, tank;
+	enum token	  tok;
 
 	for (v = NULL, ap = atts; NULL != ap[0]; ap += 2)
-		if (0 == strcmp(*ap, "time"))
+		if (TOKEN_time == divecmd_token(*ap))
 			v = ap[1];
 
 	if (NULL == v) {
@@ -631,20 +604,20 @@ parse_sample(struct parse *p, const XML_Char **atts)
 			d->datetime + (time_t)samp->time;
 
 	for (ap = atts; NULL != ap[0]; ap += 2)
-		if (0 == strcmp(*ap, "depth")) {
+		if (TOKEN_depth == (tok = divecmd_token(*ap))) {
 			samp->depth = parse_depth(p, ap[1]);
 			if (samp->depth < 0.0) {
 				logerrx(p, "bad <sample> depth");
 				return;
 			}
 			samp->flags |= SAMP_DEPTH;
-		} else if (0 == strcmp(*ap, "rbt")) {
+		} else if (TOKEN_rbt == tok) {
 			if ( ! parse_time(p, ap[1], &samp->rbt)) {
 				logerrx(p, "bad <sample> depth");
 				return;
 			}
 			samp->flags |= SAMP_RBT;
-		} else if (0 == strcmp(*ap, "temp")) {
+		} else if (TOKEN_temp == tok) {
 			samp->temp = parse_temp(p, ap[1]);
 			if (samp->temp < 0.0) {
 				logerrx(p, "bad <sample> temp");
@@ -652,8 +625,9 @@ parse_sample(struct parse *p, const XML_Char **atts)
 			}
 			samp->flags |= SAMP_TEMP;
 		} else if (0 == strncmp(*ap, "pressure", 8)) {
-			samp->pressure = xreallocarray
-				(p, samp->pressure,
+			samp->pressure = divecmd_arena_reallocarray
+				(d, samp->pressure,
+				 samp->pressuresz,
 				 samp->pressuresz + 1,
 				 sizeof(struct samppres));
 			samp->pressuresz++;
@@ -672,13 +646,13 @@ parse_sample(struct parse *p, const XML_Char **atts)
 				logerrx(p, "<sample> tank not found");
 				return;
 			}
-		} else if (0 == strcmp(*ap, "cns")) {
+		} else if (TOKEN_cns == tok) {
 			if ( ! parse_percent(ap[1], &samp->cns)) {
 				logerrx(p, "bad <sample> cns");
 				return;
 			}
 			samp->flags |= SAMP_CNS;
-		} else if (0 == strcmp(*ap, "ndl")) {
+		} else if (TOKEN_ndl == tok) {
 			memset(&samp->deco, 0, sizeof(struct sampdeco));
 			if ( ! parse_time(p, ap[1], &samp->deco.duration)) {
 				logerrx(p, "bad <sample> ndl");
@@ -686,7 +660,7 @@ parse_sample(struct parse *p, const XML_Char **atts)
 			}
 			samp->deco.type = DECO_ndl;
 			samp->flags |= SAMP_DECO;
-		} else if (0 == strcmp(*ap, "stopdepth")) {
+		} else if (TOKEN_stopdepth == tok) {
 			/*
 			 * We'll only use this if in_deco is set, later.
 			 */
@@ -695,7 +669,7 @@ parse_sample(struct parse *p, const XML_Char **atts)
 				logerrx(p, "bad <sample> stopdepth");
 				return;
 			}
-		} else if (0 == strcmp(*ap, "stoptime")) {
+		} else if (TOKEN_stoptime == tok) {
 			/*
 			 * We'll only use this if in_deco is set, later.
 			 */
@@ -703,7 +677,7 @@ parse_sample(struct parse *p, const XML_Char **atts)
 				logerrx(p, "bad <sample> stoptime");
 				return;
 			}
-		} else if (0 == strcmp(*ap, "in_deco")) {
+		} else if (TOKEN_in_deco == tok) {
 			if (0 == strcmp(ap[1], "1")) {
 				if (p->in_deco) {
 					logerrx(p, "<sample> starting deco "
@@ -722,7 +696,7 @@ parse_sample(struct parse *p, const XML_Char **atts)
 				logerrx(p, "bad <sample> in_deco");
 				return;
 			}
-		} else if (strcmp(*ap, "time"))
+		} else if (TOKEN_time != tok)
 			logwarnx(p, "unknown <sample> attribute: %s", ap[0]);
 
 	if (SAMP_DEPTH & samp->flags)
@@ -771,24 +745,25 @@ parse_cylinder(struct parse *p, const XML_Char **atts)
 	struct dive	 *d = p->curdive;
 	const char	 *size = NULL, *wp = NULL;
 	char		 *ep, *mixes[3];
+	enum token	  tok;
 
 	mixes[0] = mixes[1] = mixes[2] = NULL;
 
 	for (ap = atts; NULL != ap[0]; ap += 2)
-		if (0 == strcmp(*ap, "o2")) {
+		if (TOKEN_o2 == (tok = divecmd_token(*ap))) {
 			free(mixes[0]);
 			mixes[0] = xstrdup(p, ap[1]);
-		} else if (0 == strcmp(*ap, "n2")) {
+		} else if (TOKEN_n2 == tok) {
 			free(mixes[1]);
 			mixes[1] = xstrdup(p, ap[1]);
-		} else if (0 == strcmp(*ap, "he")) {
+		} else if (TOKEN_he == tok) {
 			free(mixes[2]);
 			mixes[2] = xstrdup(p, ap[1]);
-		} else if (0 == strcmp(*ap, "description")) {
+		} else if (TOKEN_description == tok) {
 			/* Do nothing. */ ;
-		} else if (0 == strcmp(*ap, "size")) {
+		} else if (TOKEN_size == tok) {
 			size = ap[1];
-		} else if (0 == strcmp(*ap, "workpressure")) {
+		} else if (TOKEN_workpressure == tok) {
 			wp = ap[1];
 		} else
 			logattr(p, "cylinder", *ap);
@@ -802,7 +777,8 @@ parse_cylinder(struct parse *p, const XML_Char **atts)
 		if ('\0' != mixes[0][0] &&
 		    '%' == mixes[0][strlen(mixes[0]) - 1])
 			mixes[0][strlen(mixes[0]) - 1] = '\0';
-		d->gas[d->gassz].o2 = strtod(mixes[0], &ep);
+		errno = 0;
+		d->gas[d->gassz].o2 = divecmd_strtod(mixes[0], &ep);
 		if (ep == mixes[0] || ERANGE == errno) {
 			logerrx(p, "bad \"o2\" attribute");
 			return;
@@ -813,7 +789,8 @@ parse_cylinder(struct parse *p, const XML_Char **atts)
 		if ('\0' != mixes[1][0] &&
 		     '%' == mixes[1][strlen(mixes[1]) - 1])
 			mixes[1][strlen(mixes[1]) - 1] = '\0';
-		d->gas[d->gassz].n2 = strtod(mixes[1], &ep);
+		errno = 0;
+		d->gas[d->gassz].n2 = divecmd_strtod(mixes[1], &ep);
 		if (ep == mixes[1] || ERANGE == errno) {
 			logerrx(p, "bad \"n2\" attribute");
 			return;
@@ -824,7 +801,8 @@ parse_cylinder(struct parse *p, const XML_Char **atts)
 		if ('\0' != mixes[2][0] &&
 		    '%' == mixes[2][strlen(mixes[2]) - 1])
 			mixes[2][strlen(mixes[2]) - 1] = '\0';
-		d->gas[d->gassz].he = strtod(mixes[2], &ep);
+		errno = 0;
+		d->gas[d->gassz].he = divecmd_strtod(mixes[2], &ep);
 		if (ep == mixes[2] || ERANGE == errno) {
 			logerrx(p, "bad \"he\" attribute");
 			return;
@@ -866,6 +844,7 @@ parse_dive(struct parse *p, const XML_Char **atts)
 	const char	 *num = NULL, *dur = NULL, *date = NULL,
 	      		 *time = NULL, *mode = NULL, *id = NULL, *er;
 	struct dgroup	 *grp;
+	enum token	  tok;
 
 	p->curdive = d = xcalloc(p, 1, sizeof(struct dive));
 	TAILQ_INIT(&d->samps);
@@ -875,15 +854,15 @@ parse_dive(struct parse *p, const XML_Char **atts)
 	d->mode = MODE_OC;
 
 	for (ap = atts; NULL != ap[0]; ap += 2)
-		if (0 == strcmp(*ap, "number"))
+		if (TOKEN_number == (tok = divecmd_token(*ap)))
 			num = ap[1];
-		else if (0 == strcmp(*ap, "diveid"))
+		else if (TOKEN_diveid == tok)
 			id = ap[1];
-		else if (0 == strcmp(*ap, "duration"))
+		else if (TOKEN_duration == tok)
 			dur = ap[1];
-		else if (0 == strcmp(*ap, "date"))
+		else if (TOKEN_date == tok)
 			date = ap[1];
-		else if (0 == strcmp(*ap, "time"))
+		else if (TOKEN_time == tok)
 			time = ap[1];
 		else 
 			logattr(p, "dive", *ap);
@@ -920,7 +899,7 @@ parse_dive(struct parse *p, const XML_Char **atts)
 	}
 
 	if (NULL != date && NULL != time) {
-		d->datetime = parse_date(date, time);
+		d->datetime = parse_date(p, date, time);
 		if (d->datetime < 0) {
 			logerrx(p, "bad <dive> date/time");
 			return;
@@ -978,13 +957,14 @@ parse_divecomputer(struct parse *p, const XML_Char **atts)
 {
 	const XML_Char	**ap;
 	const char	 *diveid = NULL, *dctype = NULL;
+	enum token	  tok;
 
 	p->curdive->mode = MODE_OC;
 
 	for (ap = atts; NULL != ap[0]; ap += 2)
-		if (0 == strcmp(*ap, "diveid"))
+		if (TOKEN_diveid == (tok = divecmd_token(*ap)))
 			diveid = ap[1];
-		else if (0 == strcmp(*ap, "dctype"))
+		else if (TOKEN_dctype == tok)
 			dctype = ap[1];
 
 	if (NULL != diveid)
@@ -1029,8 +1009,9 @@ static void
 parse_open(void *dat, const XML_Char *s, const XML_Char **atts)
 {
 	struct parse	 *p = dat;
+	enum token	  tok = divecmd_token(s);
 
-	if (0 == strcmp(s, "divelog")) {
+	if (TOKEN_divelog == tok) {
 		if (NULL != p->curlog) {
 			logerrx(p, "nested <divelog>");
 			return;
@@ -1040,12 +1021,12 @@ parse_open(void *dat, const XML_Char *s, const XML_Char **atts)
 		p->curlog->line = XML_GetCurrentLineNumber(p->p);
 		TAILQ_INSERT_TAIL(&p->stat->dlogs, p->curlog, entries);
 		logdbg(p, "new divelog");
-	} else if (0 == strcmp(s, "divecomputer")) {
+	} else if (TOKEN_divecomputer == tok) {
 		if (NULL == p->curdive)
 			logerrx(p, "<divecomputer> not in <dive>");
 		else
 			parse_divecomputer(p, atts);
-	} else if (0 == strcmp(s, "dive")) {
+	} else if (TOKEN_dive == tok) {
 		if (NULL != p->curdive) {
 			logerrx(p, "nested <dive>");
 			return;
@@ -1054,61 +1035,61 @@ parse_open(void *dat, const XML_Char *s, const XML_Char **atts)
 			return;
 		}
 		parse_dive(p, atts);
-	} else if (0 == strcmp(s, "cylinder")) {
+	} else if (TOKEN_cylinder == tok) {
 		if (NULL == p->curdive) { 
 			logerrx(p, "<cylinder> not in <dive>");
 			return;
 		}
 		parse_cylinder(p, atts);
-	} else if (0 == strcmp(s, "sample")) {
+	} else if (TOKEN_sample == tok) {
 		if (NULL == p->curdive) { 
 			logerrx(p, "<sample> not in <dive>");
 			return;
 		}
 		parse_sample(p, atts);
-	} else if (0 == strcmp(s, "event")) {
+	} else if (TOKEN_event == tok) {
 		if (NULL == p->curdive) { 
 			logerrx(p, "<event> not in <dive>");
 			return;
 		}
 		parse_event(p, atts);
-	} else if (0 == strcmp(s, "extradata")) {
+	} else if (TOKEN_extradata == tok) {
 		if (NULL == p->curdive) {
 			logerrx(p, "<extradata> not in <dive>");
 			return;
 		}
-	} else if (0 == strcmp(s, "dives")) {
+	} else if (TOKEN_dives == tok) {
 		if (NULL == p->curlog)
 			logerrx(p, "<dives> not in <divelog>");
-	} else if (0 == strcmp(s, "settings")) {
+	} else if (TOKEN_settings == tok) {
 		if (NULL != p->curdive)
 			logerrx(p, "<settings> in <dive>");
-	} else if (0 == strcmp(s, "divecomputerid")) {
+	} else if (TOKEN_divecomputerid == tok) {
 		if (NULL == p->curlog) {
 			logerrx(p, "<divecomputerid> not in <divelog>");
 			return;
 		}
 		parse_divecomputerid(p, atts);
-	} else if (0 == strcmp(s, "water")) {
+	} else if (TOKEN_water == tok) {
 		if (NULL == p->curdive) {
 			logerrx(p, "<water> not in <dive>");
 			return;
 		}
-	} else if (0 == strcmp(s, "depth")) {
+	} else if (TOKEN_depth == tok) {
 		if (NULL == p->curdive) {
 			logerrx(p, "<depth> not in <dive>");
 			return;
 		}
-	} else if (0 == strcmp(s, "temperature")) {
+	} else if (TOKEN_temperature == tok) {
 		if (NULL == p->curdive) {
 			logerrx(p, "<temperature> not in <dive>");
 			return;
 		}
-	} else if (0 == strcmp(s, "divesites")) {
+	} else if (TOKEN_divesites == tok) {
 		p->ign = xstrdup(p, s);
 		p->igndepth = 1;
 		XML_SetElementHandler(p->p, ign_open, ign_close);
-	} else if (0 == strcmp(s, "surface")) {
+	} else if (TOKEN_surface == tok) {
 		if (NULL == p->curdive) {
 			logerrx(p, "<surface> not in <dive>");
 			return;
@@ -1127,10 +1108,11 @@ static void
 parse_close(void *dat, const XML_Char *s)
 {
 	struct parse	*p = dat;
+	enum token	 tok = divecmd_token(s);
 
-	if (0 == strcmp(s, "divelog"))
+	if (TOKEN_divelog == tok)
 		p->curlog = NULL;
-	else if (0 == strcmp(s, "dive"))
+	else if (TOKEN_dive == tok)
 		p->curdive = NULL;
 }
 
@@ -1138,11 +1120,8 @@ static int
 ssrf_parse(const char *fname, XML_Parser p, 
 	struct diveq *dq, struct divestat *st)
 {
-	int	 	 fd;
+	int	 	 fd, rc;
 	struct parse	 pp;
-	ssize_t		 ssz;
-	char		 buf[BUFSIZ];
-	enum XML_Status	 rc;
 
 	fd = strcmp("-", fname) ? 
 		open(fname, O_RDONLY, 0) : STDIN_FILENO;
@@ -1162,22 +1141,12 @@ ssrf_parse(const char *fname, XML_Parser p,
 	XML_SetElementHandler(p, parse_open, parse_close);
 	XML_SetUserData(p, &pp);
 
-	while ((ssz = read(fd, buf, sizeof(buf))) > 0) {
-	       rc = XML_Parse(p, buf, (int)ssz, 0 == ssz ? 1 : 0);
-	       if (XML_STATUS_OK != rc) {
-		       logerrp(&pp);
-		       break;
-	       } else if (0 == ssz)
-		       break;
-	}
-
-
-	if (ssz < 0)
-		warn("%s", fname);
+	if (0 == (rc = divecmd_feed(p, fd, fname)))
+		logerrp(&pp);
 
 	close(fd);
 	free(pp.ign);
-	return 0 == ssz;
+	return rc > 0;
 }
 
 int
@@ -1212,7 +1181,7 @@ main(int argc, char *argv[])
 	argv += optind;
 
 	divecmd_init(&p, &dq, &st, 
-		GROUP_NONE, GROUPSORT_DATETIME);
+		GROUP_NONE, GROUPSORT_DATETIME, WANT_ALL);
 
 	if (0 == argc)
 		if ( ! ssrf_parse("-", p, &dq, &st))
@@ -31,6 +31,7 @@
 
 struct	dcmd_xml {
 	FILE		*f; /* output stream */
+	int		 stream; /* dives only into caller's stream */
 };
 
 struct	dcmd_samp {
@@ -91,6 +92,8 @@ static	const char *dcmd_event_types[] = {
 	"gaschange2", /* SAMPLE_EVENT_GASCHANGE2 */
 };
 
+static	const char hexdigs[] = "0123456789abcdef";
+
 /*
  * A DC_SAMPLE_TIME means that we're encountering a new sample.
  */
@@ -98,8 +101,9 @@ static void
 sample_cb(dc_sample_type_t type, dc_sample_value_t v, void *userdata)
 {
 	struct dcmd_samp *sd = userdata;
-	unsigned int	  i, j;
+	unsigned int	  i, j, k;
 	const unsigned char *cp;
+	char		  line[6 + 32 + 1];
 
 	switch (type) {
 	case DC_SAMPLE_TIME:
@@ -122,11 +126,15 @@ sample_cb(dc_sample_type_t type, dc_sample_value_t v, void *userdata)
 		fprintf(sd->f, "\t\t\t\t\t"
 			"<vendor type=\"%u\">\n", v.vendor.type);
 		cp = v.vendor.data;
+		memset(line, '\t', 6);
 		for (i = 0; i < v.vendor.size; ) {
-			fprintf(sd->f, "\t\t\t\t\t\t");
-			for (j = 0; i < v.vendor.size && j < 16; j++, i++)
-				fprintf(sd->f, "%02x", cp[i]);
-			fprintf(sd->f, "\n");
+			k = 6;
+			for (j = 0; i < v.vendor.size && j < 16; j++, i++) {
+				line[k++] = hexdigs[cp[i] >> 4];
+				line[k++] = hexdigs[cp[i] & 0x0f];
+			}
+			line[k++] = '\n';
+			fwrite(line, 1, k, sd->f);
 		}
 		fprintf(sd->f, "\t\t\t\t\t"
 			"</vendor>\n");
@@ -191,6 +199,7 @@ output_xml_new(dc_descriptor_t *descriptor, const char *ident)
 		err(EXIT_FAILURE, NULL);
 
 	p->f = stdout;
+	p->stream = 0;
 
 	fprintf(p->f, 
 		"<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n"
@@ -206,6 +215,24 @@ output_xml_new(dc_descriptor_t *descriptor, const char *ident)
 	return((struct dcmd_out *)p);
 }
 
+/*
+ * Like output_xml_new(), but only the dives are written into "f",
+ * without the enclosing <divelog>, to be copied into a real output.
+ * The stream isn't closed by output_xml_free().
+ */
+struct dcmd_out *
+output_xml_new_stream(FILE *f)
+{
+	struct dcmd_xml *p = NULL;
+
+	if (NULL == (p = malloc(sizeof(struct dcmd_xml))))
+		err(EXIT_FAILURE, NULL);
+
+	p->f = f;
+	p->stream = 1;
+	return((struct dcmd_out *)p);
+}
+
 /*
  * Start with the prologue:
  * 
@@ -472,6 +499,11 @@ output_xml_free(struct dcmd_out *abstract)
 	if (NULL == output)
 		return(DC_STATUS_SUCCESS);
 
+	if (output->stream) {
+		free(output);
+		return(DC_STATUS_SUCCESS);
+	}
+
 	fputs("\t</dives>\n"
       	      "</divelog>\n", output->f);
 